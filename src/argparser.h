@@ -7,6 +7,10 @@
 #include <string>
 #include <glm/glm.hpp>
 #include <random>
+#include <atomic>
+#include <vector>
+#include <initializer_list>
+#include <thread>
 
 // ================================================================================
 // ================================================================================
@@ -78,6 +82,69 @@ public:
       } else if (argv[i] == std::string("-offset_increment")) {
         i++; assert(i < argc);
         sscanf(argv[i], "%f", &offset_increment);
+      } else if (argv[i] == std::string("-output") ||
+          argv[i] == std::string("-o")) {
+        i++; assert(i < argc);
+        output_prefix = argv[i];
+      } else if (argv[i] == std::string("-output_format")) {
+        i++; assert(i < argc);
+        output_format = argv[i];
+        if (output_format != "obj" && output_format != "stl") {
+          std::cout << "ERROR: -output_format must be obj or stl" << std::endl;
+          exit(1);
+        }
+      } else if (argv[i] == std::string("-stream")) {
+        i++; assert(i < argc);
+        stream_input = argv[i];
+      } else if (argv[i] == std::string("-chunk_size")) {
+        i++; assert(i < argc);
+        stream_chunk_mb = atoi(argv[i]);
+        assert (stream_chunk_mb > 0);
+      } else if (argv[i] == std::string("-plan")) {
+        i++; assert(i < argc);
+        plan_file = argv[i];
+      } else if (argv[i] == std::string("-save_plan")) {
+        i++; assert(i < argc);
+        save_plan_file = argv[i];
+      } else if (argv[i] == std::string("-result_cache")) {
+        i++; assert(i < argc);
+        result_cache_dir = argv[i];
+      } else if (argv[i] == std::string("-result_cache_size")) {
+        i++; assert(i < argc);
+        result_cache_mb = atoi(argv[i]);
+      } else if (argv[i] == std::string("-no_result_cache")) {
+        result_cache = false;
+      } else if (argv[i] == std::string("-batch")) {
+        batch = true;
+      } else if (argv[i] == std::string("-continuous")) {
+        continuous = true;
+      } else if (argv[i] == std::string("-frame_timing")) {
+        frame_timing = true;
+      } else if (argv[i] == std::string("-full_detail")) {
+        full_detail = true;
+      } else if (argv[i] == std::string("-thumbnail")) {
+        i++; assert(i < argc);
+        thumbnail_file = argv[i];
+      } else if (argv[i] == std::string("-thumbnail_size")) {
+        i++; assert(i < argc);
+        thumbnail_width = atoi(argv[i]);
+        i++; assert(i < argc);
+        thumbnail_height = atoi(argv[i]);
+        assert (thumbnail_width > 0 && thumbnail_height > 0);
+      } else if (argv[i] == std::string("-thumbnail_camera")) {
+        i++; assert(i < argc);
+        thumbnail_camera = argv[i];
+      } else if (argv[i] == std::string("-no_cache")) {
+        mesh_cache = false;
+      } else if (argv[i] == std::string("-weld")) {
+        i++; assert(i < argc);
+        sscanf(argv[i], "%f", &weld_tolerance);
+        weld = true;
+      } else if (argv[i] == std::string("-no_weld")) {
+        weld = false;
+      } else if (argv[i] == std::string("-seed")) {
+        i++; assert(i < argc);
+        random_seed = strtoul(argv[i], NULL, 10);
       } else {
 	std::cout << "ERROR: unknown command line argument "
 		  << i << ": '" << argv[i] << "'" << std::endl;
@@ -86,23 +153,63 @@ public:
     }
   }
 
+  // uniform in [0,1).  Every thread draws from its own stream of the
+  // random_seed.  The main thread uses stream {0}; a parallel task
+  // should call seedRandom() with numbers identifying its work (not the
+  // thread it happens to run on), so that a run with -seed reproduces
+  // exactly.  Threads that never call it get an unused stream of their
+  // own.
   double rand() {
-#if 1
-    // random seed
-    static std::random_device rd;
-    static std::mt19937 engine(rd());
-#else
-    // deterministic randomness
-    static std::mt19937 engine(37);
-#endif
-    static std::uniform_real_distribution<double> dist(0.0, 1.0);
-    return dist(engine);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    return dist(randomEngine());
+  }
+  void seedRandom(std::initializer_list<unsigned int> work) {
+    std::vector<unsigned int> values(1, random_seed);
+    values.insert(values.end(), work.begin(), work.end());
+    std::seed_seq seq(values.begin(), values.end());
+    randomEngine().seed(seq);
+  }
+
+  std::mt19937& randomEngine() {
+    static std::atomic<unsigned int> next_stream(1);
+    static thread_local std::mt19937 engine;
+    static thread_local bool seeded = false;
+    if (!seeded) {
+      seeded = true;
+      unsigned int stream = (std::this_thread::get_id() == main_thread) ? 0 : next_stream++;
+      std::seed_seq seq = { random_seed, stream };
+      engine.seed(seq);
+    }
+    return engine;
+  }
+
+  // the tolerance the mesh is welded with, -1 when welding is off
+  float effectiveWeldTolerance() const {
+    if (!weld) return -1;
+    return (weld_tolerance > 0) ? weld_tolerance : 0;
   }
 
   void DefaultValues() {
     // BASIC RENDERING PARAMETERS
     input_file = "";
     path = "";
+    output_prefix = "";
+    output_format = "obj";
+    stream_input = "";
+    plan_file = "";
+    save_plan_file = "";
+    batch = false;
+    continuous = false;
+    frame_timing = false;
+    full_detail = false;
+    thumbnail_file = "";
+    thumbnail_camera = "";
+    thumbnail_width = 512;
+    thumbnail_height = 512;
+    result_cache = true;
+    result_cache_dir = "";
+    result_cache_mb = 64;
+    stream_chunk_mb = 64;
     shader_filename = "hw4_shader";
     width = 500;
     height = 500;
@@ -111,6 +218,9 @@ public:
     printing_length = 0.1;
     beam_width = 4;
     offset_increment = 0.01;
+    mesh_cache = true;
+    weld = true;
+    weld_tolerance = 0;
     geometry = true;
     wireframe = 0;
     bounding_box = false;
@@ -118,6 +228,9 @@ public:
     a_part = 1.0;
     a_util = 0.05;
     a_connector = 1.0;
+    // a fresh seed every run unless -seed is given
+    random_seed = std::random_device()();
+    main_thread = std::this_thread::get_id();
   }
 
   // ==============
@@ -127,6 +240,33 @@ public:
   // BASIC RENDERING PARAMETERS
   std::string input_file;
   std::string path;
+  std::string output_prefix;
+  std::string output_format;
+  // full resolution mesh the final cuts are streamed through on export
+  // (e.g. when the search ran on a simplified version of it)
+  std::string stream_input;
+  int stream_chunk_mb;
+  // replay this cut plan instead of searching / save the plan found
+  std::string plan_file;
+  std::string save_plan_file;
+  // no window: cut, write the partitions & exit
+  bool batch;
+  // redraw the window every frame (not only when something changed)
+  bool continuous;
+  // show the CPU & GPU time of drawing a frame in the window title
+  bool frame_timing;
+  // draw every part at full resolution, even off screen
+  bool full_detail;
+  // after -batch, draw the partitions into this image (no GL needed),
+  // seen by the camera saved in thumbnail_camera ("" = the default view)
+  std::string thumbnail_file;
+  std::string thumbnail_camera;
+  int thumbnail_width;
+  int thumbnail_height;
+  // reuse search results of earlier runs (directory "" = next to the input)
+  bool result_cache;
+  std::string result_cache_dir;
+  int result_cache_mb;
   std::string shader_filename;
   int width;
   int height;
@@ -135,11 +275,21 @@ public:
   float printing_length;
   int beam_width;
   float offset_increment;
+  // read/write the binary mesh cache next to the input file
+  bool mesh_cache;
+  // merge vertices closer than weld_tolerance when loading
+  // (0 = only identical positions)
+  bool weld;
+  float weld_tolerance;
   bool geometry;
   GLint wireframe;
   bool bounding_box;
   bool gouraud_normals;
 
+  // seeds the random streams (mesh colours)
+  unsigned int random_seed;
+  std::thread::id main_thread;
+
   // objective function weight coefficients
   float a_part;
   float a_util;
@@ -19,6 +19,10 @@ void BoundingBox::setupVBOs() {
 
   float thickness = 0.001*glm::length(maximum-minimum);
 
+  // (start over, the box may have changed since the last call)
+  bb_verts.clear();
+  bb_tri_indices.clear();
+
   glm::vec3& A = minimum;
   glm::vec3& B = maximum;
 
@@ -56,7 +60,7 @@ void BoundingBox::drawVBOs() {
                         3,                  // size
                         GL_FLOAT,           // type
                         GL_FALSE,           // normalized?
-                        3*sizeof(glm::vec3),// stride
+                        sizeof(VBOPosNormalColor),// stride
                         (void*)0            // array buffer offset
                         );
   // triangle vertex normals
@@ -65,7 +69,7 @@ void BoundingBox::drawVBOs() {
                         3,                      // size
                         GL_FLOAT,               // type
                         GL_FALSE,               // normalized?
-                        3*sizeof(glm::vec3),    // stride
+                        sizeof(VBOPosNormalColor),// stride
                         (void*)sizeof(glm::vec3)// array buffer offset
                         );
   // triangle vertex colors
@@ -74,7 +78,7 @@ void BoundingBox::drawVBOs() {
                         3,                          // size
                         GL_FLOAT,                   // type
                         GL_FALSE,                   // normalized?
-                        3*sizeof(glm::vec3),        // stride
+                        sizeof(VBOPosNormalColor),  // stride
                         (void*)(sizeof(glm::vec3)*2)// array buffer offset
                         );
   // triangle indices
@@ -89,8 +93,11 @@ void BoundingBox::drawVBOs() {
 }
 
 void BoundingBox::cleanupVBOs() {
+  // (0 = never initialized, e.g. when running without a window)
+  if (bb_verts_VBO == 0) return;
   glDeleteBuffers(1, &bb_verts_VBO);
   glDeleteBuffers(1, &bb_tri_indices_VBO);
+  bb_verts_VBO = bb_tri_indices_VBO = 0;
 }
 
 
@@ -26,10 +26,13 @@ public:
   // ========================
   // CONSTRUCTOR & DESTRUCTOR
   BoundingBox() {
+    bb_verts_VBO = bb_tri_indices_VBO = 0;
     Set(glm::vec3(0,0,0),glm::vec3(0,0,0)); }
   BoundingBox(const glm::vec3 &pos) {
+    bb_verts_VBO = bb_tri_indices_VBO = 0;
     Set(pos,pos); }
   BoundingBox(const glm::vec3 &_minimum, const glm::vec3 &_maximum) {
+    bb_verts_VBO = bb_tri_indices_VBO = 0;
     Set(_minimum,_maximum); }
 
   // =========
@@ -51,7 +54,7 @@ public:
     double z = maximum.z - minimum.z;
     return mymax(x,mymax(y,z));
   }
-  float getVolume() {
+  float getVolume() const {
     glm::vec3 bbDimensions = maximum - minimum;
     return bbDimensions.x * bbDimensions.y * bbDimensions.z;
   }
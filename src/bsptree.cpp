@@ -1,7 +1,17 @@
+#include <utility>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "bsptree.h"
 #include "triangle.h"
 #include "utils.h"
 
+// triangles / vertices per work item of the split
+static const int SPLIT_CHUNK = 4096;
+
 // COPY CONSTRUCTOR
 BSPTree::BSPTree(const BSPTree &tree) : myMesh(tree.myMesh) {
 	normal = tree.normal;
@@ -20,24 +30,48 @@ BSPTree::BSPTree(const BSPTree &tree) : myMesh(tree.myMesh) {
 	}
 }
 
-// ASSIGNMENT OPERATOR
-BSPTree& BSPTree::operator= (const BSPTree& tree) {
+// MOVE CONSTRUCTOR
+BSPTree::BSPTree(BSPTree &&tree) : myMesh(std::move(tree.myMesh)) {
 	normal = tree.normal;
 	offset = tree.offset;
 	args = tree.args;
 	depth = tree.depth;
 	grade = tree.grade;
-	myMesh = tree.myMesh;
+	leftChild = tree.leftChild;
+	rightChild = tree.rightChild;
+	tree.leftChild = NULL;
+	tree.rightChild = NULL;
+}
 
-	// printf("ASSIGNMENT OP\n");
-	if (!tree.isLeaf()) {
-		leftChild = new BSPTree(*(tree.leftChild));
-		rightChild = new BSPTree(*(tree.rightChild));
-	} else {
-		leftChild = NULL;
-		rightChild = NULL;
-	}
+// ASSIGNMENT OPERATOR
+BSPTree& BSPTree::operator= (const BSPTree& tree) {
+	if (this == &tree) return *this;
+	// copy first, tree may be one of our own descendants
+	BSPTree copy(tree);
+	*this = std::move(copy);
+	return *this;
+}
+
+// MOVE ASSIGNMENT OPERATOR
+BSPTree& BSPTree::operator= (BSPTree&& tree) {
+	if (this == &tree) return *this;
+	BSPTree *oldLeft = leftChild;
+	BSPTree *oldRight = rightChild;
 
+	normal = tree.normal;
+	offset = tree.offset;
+	args = tree.args;
+	depth = tree.depth;
+	grade = tree.grade;
+	myMesh = std::move(tree.myMesh);
+	leftChild = tree.leftChild;
+	rightChild = tree.rightChild;
+	tree.leftChild = NULL;
+	tree.rightChild = NULL;
+
+	// the old children used to be leaked here
+	delete oldLeft;
+	delete oldRight;
 	return *this;
 }
 
@@ -64,378 +98,239 @@ BSPTree::~BSPTree() {
 	// printf("cleared mesh\n");
 }
 
-float BSPTree::CastRay(const glm::vec3& dir, const glm::vec3& origin, const glm::vec3& normal, float offset) const {
-	// equation for a plane
-	// ax + by + cz = d;
-	// normal . p + direction = 0
-	// plug in ray
-	// origin + direction * t = p(t)
-	// origin . normal + t * direction . normal = d;
-	// t = d - origin.normal / direction.normal;
+// cuts the mesh along the plane
+void BSPTree::chop(const glm::vec3& normal, float offset) {
+	// printf("begin chop %f %f %f, %f\n", normal.x, normal.y, normal.z, offset);
+	assert(isLeaf());
+	assert(numVertices() > 0);
+	leftChild = new BSPTree(args, depth+1);
+	rightChild = new BSPTree(args, depth+1);
+	this->normal = normal;
+	this->offset = offset;
 
-	return (offset - glm::dot(origin, normal)) / glm::dot(dir, normal);
+	SplitMesh(myMesh, normal, offset, leftChild->myMesh, rightChild->myMesh);
 }
 
-// function that adds a triangle to the left/right child mesh
-// denoted by the side parameter; 0=right, 1=left for indexing in childVertices
-// needs to check whether that vertex has already been added to the mesh
-// if triangle being added is intersecting the plane, don't want its vertices to impact the bounding box
-Triangle* BSPTree::addTriangle(Vertex* a, Vertex* b, Vertex* c, int side, std::vector<std::vector<Vertex*> >& childVertices,
-																bool addToBoundingBox) {
-	Vertex* newA;
-	Vertex* newB;
-	Vertex* newC;
-
-	// checking if the vertices have already been added to the child mesh and
-	// uses its pointer if it has
-	// if not, creates a vertex with that position and updates childVertices with that pointer
-	if (childVertices[a->getIndex()][side] != NULL) {
-		newA = childVertices[a->getIndex()][side];
-	} else {
-		newA = myMesh.addVertex(a->getPos(), addToBoundingBox);
-		childVertices[a->getIndex()][side] = newA;
+// ===============
+// SPLIT
+// The cut is made in data parallel passes over flat arrays: every
+// triangle is classified (whole on one side, or straddling) and counts
+// the pieces it gives each child, prefix sums over those counts give
+// every piece its place in the child index arrays, and the pieces are
+// written in parallel.  A corner on the plane belongs to both sides, so
+// only edges with corners strictly on opposite sides are cut.  The new
+// vertices on the plane are keyed by the edge they cut, so the two
+// triangles sharing an edge share the vertex.  Each child is then built
+// in one go with Mesh::Build (the two builds run side by side).  Meshes
+// smaller than BSP_PARALLEL_SPLIT_TRIANGLES take the same passes on one
+// thread; the output doesn't depend on the number of threads.
+
+// exclusive prefix sums of counts, in parallel chunks; returns the total
+static int ChunkedPrefixSum(const std::vector<int> &counts, std::vector<int> &offsets, bool parallel) {
+	int n = counts.size();
+	int num_chunks = (n + SPLIT_CHUNK - 1) / SPLIT_CHUNK;
+	std::vector<int> chunk_offsets(num_chunks+1, 0);
+	offsets.resize(n);
+	#pragma omp parallel for schedule(static) if(parallel)
+	for (int c = 0; c < num_chunks; c++) {
+		int sum = 0;
+		for (int i = c*SPLIT_CHUNK; i < std::min(n, (c+1)*SPLIT_CHUNK); i++) {
+			sum += counts[i];
+		}
+		chunk_offsets[c+1] = sum;
 	}
-
-	if (childVertices[b->getIndex()][side] != NULL) {
-		newB = childVertices[b->getIndex()][side];
-	} else {
-		newB = myMesh.addVertex(b->getPos(), addToBoundingBox);
-		childVertices[b->getIndex()][side] = newB;
+	for (int c = 0; c < num_chunks; c++) {
+		chunk_offsets[c+1] += chunk_offsets[c];
 	}
-
-	if (childVertices[c->getIndex()][side] != NULL) {
-		newC = childVertices[c->getIndex()][side];
-	} else {
-		newC = myMesh.addVertex(c->getPos(), addToBoundingBox);
-		childVertices[c->getIndex()][side] = newC;
+	#pragma omp parallel for schedule(static) if(parallel)
+	for (int c = 0; c < num_chunks; c++) {
+		int sum = chunk_offsets[c];
+		for (int i = c*SPLIT_CHUNK; i < std::min(n, (c+1)*SPLIT_CHUNK); i++) {
+			offsets[i] = sum;
+			sum += counts[i];
+		}
 	}
-
-	// add triangle
-	return myMesh.addTriangle(newA, newB, newC);
+	return chunk_offsets[num_chunks];
 }
 
-// cuts off the excess parts of triangles crossing the cutting plane
-// assumes child always in direction of "right" of plane to reduce having to check which side its on
-void BSPTree::pruneChildMesh(const glm::vec3& normal, float offset, std::vector<Triangle*>& trianglesToRemove) {
-	// clear out any previous relationships between vertices
-  myMesh.vertex_parents.clear();
-
-	glm::vec3 pointOnPlane = normal * offset;
-
-	// loop through all the triangles to find the triangles that cross the boundary
-	for (unsigned int i=0; i<trianglesToRemove.size(); i++) {
-
-		Triangle *t = trianglesToRemove[i];
-		Vertex *avert = (*t)[0];
-		Vertex *bvert = (*t)[1];
-		Vertex *cvert = (*t)[2];
-		glm::vec3 a = avert->getPos();
-		glm::vec3 b = bvert->getPos();
-		glm::vec3 c = cvert->getPos();
-
-		float distA = glm::dot(normal, a-pointOnPlane);
-		float distB = glm::dot(normal, b-pointOnPlane);
-		float distC = glm::dot(normal, c-pointOnPlane);
-
-		glm::vec3 Vab = glm::normalize(b - a), Vbc = glm::normalize(c - b), Vca = glm::normalize(a - c);
-		glm::vec3 aint = a + Vab * CastRay(Vab, a, normal, offset);
-		glm::vec3 bint = b + Vbc * CastRay(Vbc, b, normal, offset);
-		glm::vec3 cint = c + Vca * CastRay(Vca, c, normal, offset);
-		glm::vec3 p1, p2;
-		Vertex *newPoint1;
-		Vertex *newPoint2;
-
-		// a is left, others are right
-		if (distA < 0 && distB > 0 && distC > 0) {
-			p1 = cint;
-			p2 = aint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex and set its parent
-			newPoint1 = myMesh.getChildVertex(cvert, avert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(cvert, avert, newPoint1);
-			}
-			newPoint2 = myMesh.getChildVertex(avert, bvert);
-			if (newPoint2 == NULL) {
-				newPoint2 = myMesh.addVertex(p2);
-				myMesh.setParentsChild(avert, bvert, newPoint2);
-			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
-
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(cvert,newPoint1,newPoint2);
-			myMesh.addTriangle(bvert,cvert,newPoint2);
-			continue;
-		}
-
-		// b is left, others are right
-		if (distB < 0 && distA > 0 && distC > 0) {
-			p1 = aint;
-			p2 = bint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(avert, bvert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(avert, bvert, newPoint1);
-			}
-			newPoint2 = myMesh.getChildVertex(bvert, cvert);
-			if (newPoint2 == NULL) {
-				newPoint2 = myMesh.addVertex(p2);
-				myMesh.setParentsChild(bvert, cvert, newPoint2);
-			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
+static unsigned long long EdgeKey(unsigned int a, unsigned int b) {
+	return ((unsigned long long)std::min(a,b) << 32) | std::max(a,b);
+}
 
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(avert,newPoint1,newPoint2);
-			myMesh.addTriangle(cvert,avert,newPoint2);
-			continue;
+// the vertices (parent indices, or num_vertices + seam number) of the
+// part of triangle t on one side of the plane (side 0 = right, d >= 0)
+static int ClipCorners(const unsigned int *corners, const float *d, int side,
+                       const std::vector<unsigned long long> &seams, unsigned int num_vertices,
+                       unsigned int *polygon) {
+	int n = 0;
+	for (int i = 0; i < 3; i++) {
+		int j = (i+1) % 3;
+		if ((side == 0) ? (d[i] >= 0) : (d[i] <= 0)) polygon[n++] = corners[i];
+		if ((d[i] < 0 && d[j] > 0) || (d[i] > 0 && d[j] < 0)) {
+			unsigned long long key = EdgeKey(corners[i], corners[j]);
+			std::vector<unsigned long long>::const_iterator seam =
+				std::lower_bound(seams.begin(), seams.end(), key);
+			assert(seam != seams.end() && *seam == key);
+			polygon[n++] = num_vertices + (seam - seams.begin());
 		}
+	}
+	return n;
+}
 
-		// c is left, others are right
-		if (distC < 0 && distA > 0 && distB > 0) {
-			p1 = bint;
-			p2 = cint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(bvert, cvert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(bvert, cvert, newPoint1);
-			}
-			newPoint2 = myMesh.getChildVertex(cvert, avert);
-			if (newPoint2 == NULL) {
-				newPoint2 = myMesh.addVertex(p2);
-				myMesh.setParentsChild(cvert, avert, newPoint2);
-			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
-
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(bvert,newPoint1,newPoint2);
-			myMesh.addTriangle(avert,bvert,newPoint2);
-			continue;
-		}
+// renumbers the vertices one child uses (keeping their order) and
+// gathers their positions
+static void CompactChild(const std::vector<glm::vec3> &positions, std::vector<unsigned int> &indices,
+                         std::vector<glm::vec3> &child_positions, bool parallel) {
+	int num_positions = positions.size();
+	int num_indices = indices.size();
+	std::vector<int> used(num_positions, 0);
+	for (int i = 0; i < num_indices; i++) {
+		used[indices[i]] = 1;
+	}
+	std::vector<int> new_index;
+	int num_used = ChunkedPrefixSum(used, new_index, parallel);
+	child_positions.resize(num_used);
+	#pragma omp parallel for schedule(static) if(parallel)
+	for (int i = 0; i < num_positions; i++) {
+		if (used[i]) child_positions[new_index[i]] = positions[i];
+	}
+	#pragma omp parallel for schedule(static) if(parallel)
+	for (int i = 0; i < num_indices; i++) {
+		indices[i] = new_index[indices[i]];
+	}
+}
 
-		// a is right, others are left
-		if (distA > 0 && distB < 0 && distC < 0) {
-			p1 = aint;
-			p2 = cint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(avert, bvert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(avert, bvert, newPoint1);
-			}
-			newPoint2 = myMesh.getChildVertex(cvert, avert);
-			if (newPoint2 == NULL) {
-				newPoint2 = myMesh.addVertex(p2);
-				myMesh.setParentsChild(cvert, avert, newPoint2);
-			}
+// splits mesh along the plane into the (empty) left & right meshes,
+// mesh itself isn't modified
+void BSPTree::SplitMesh(const Mesh& mesh, const glm::vec3& normal, float offset, Mesh& left, Mesh& right) {
+	assert(mesh.numVertices() > 0);
+	assert(left.numVertices() == 0 && right.numVertices() == 0);
 
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
+	glm::vec3 pointOnPlane = normal * offset;
+	int num_vertices = mesh.numVertices();
+	int num_triangles = mesh.numTriangles();
+	// (the choice doesn't depend on the number of threads, so results
+	// are the same on any machine)
+	bool parallel = num_triangles >= BSP_PARALLEL_SPLIT_TRIANGLES;
+
+	// flat copies of the parent: positions, distances & corner indices
+	std::vector<Triangle*> triangles;
+	triangles.reserve(num_triangles);
+	for (triangleshashtype::const_iterator iter = mesh.triangles.begin();
+       iter != mesh.triangles.end(); iter++) {
+		triangles.push_back(iter->second);
+	}
+	std::vector<glm::vec3> positions(num_vertices);
+	std::vector<float> dist(num_vertices);
+	#pragma omp parallel for schedule(static) if(parallel)
+	for (int i = 0; i < num_vertices; i++) {
+		positions[i] = mesh.vertices[i]->getPos();
+		dist[i] = glm::dot(normal, positions[i]-pointOnPlane);
+	}
 
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(avert,newPoint1,newPoint2);
-			continue;
+	// classify: the number of pieces each triangle gives the right & left
+	// child, and the number of edges it has crossing the plane
+	std::vector<unsigned int> corners(3*num_triangles);
+	std::vector<int> right_count(num_triangles), left_count(num_triangles), seam_count(num_triangles);
+	#pragma omp parallel for schedule(static, SPLIT_CHUNK) if(parallel)
+	for (int t = 0; t < num_triangles; t++) {
+		float d[3];
+		int num_right = 0, num_left = 0, num_crossings = 0;
+		for (int k = 0; k < 3; k++) {
+			corners[3*t+k] = (*triangles[t])[k]->getIndex();
+			d[k] = dist[corners[3*t+k]];
+			if (d[k] >= 0) num_right++;
+			if (d[k] <= 0) num_left++;
 		}
-
-		// b is right, others are left
-		if (distB > 0 && distA < 0 && distC < 0) {
-			p1 = bint;
-			p2 = aint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(bvert, cvert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(bvert, cvert, newPoint1);
-			}
-			newPoint2 = myMesh.getChildVertex(avert, bvert);
-			if (newPoint2 == NULL) {
-				newPoint2 = myMesh.addVertex(p2);
-				myMesh.setParentsChild(avert, bvert, newPoint2);
-			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
-
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(bvert,newPoint1,newPoint2);
-			continue;
+		for (int k = 0; k < 3; k++) {
+			int j = (k+1) % 3;
+			if ((d[k] < 0 && d[j] > 0) || (d[k] > 0 && d[j] < 0)) num_crossings++;
 		}
-
-		// c is right, others are left
-		if (distC > 0 && distA < 0 && distB < 0) {
-			p1 = cint;
-			p2 = bint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(cvert, avert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(cvert, avert, newPoint1);
-			}
-			newPoint2 = myMesh.getChildVertex(bvert, cvert);
-			if (newPoint2 == NULL) {
-				newPoint2 = myMesh.addVertex(p2);
-				myMesh.setParentsChild(bvert, cvert, newPoint2);
-			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
-
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(cvert,newPoint1,newPoint2);
-			continue;
+		if (num_right == 3) {
+			// (touching the plane counts as right)
+			right_count[t] = 1; left_count[t] = 0;
+		} else if (num_left == 3) {
+			right_count[t] = 0; left_count[t] = 1;
+		} else {
+			// a straddling triangle is clipped into a triangle or a quad
+			// on each side, which is triangulated as a fan
+			right_count[t] = num_right + num_crossings - 2;
+			left_count[t] = num_left + num_crossings - 2;
 		}
+		seam_count[t] = num_crossings;
+	}
 
-		// a is on the plane
-		if (distA == 0) {
-			p1 = bint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(bvert, cvert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(bvert, cvert, newPoint1);
+	// one new vertex per crossing edge
+	std::vector<int> seam_offsets;
+	int num_seam_keys = ChunkedPrefixSum(seam_count, seam_offsets, parallel);
+	std::vector<unsigned long long> seams(num_seam_keys);
+	#pragma omp parallel for schedule(static, SPLIT_CHUNK) if(parallel)
+	for (int t = 0; t < num_triangles; t++) {
+		if (seam_count[t] == 0) continue;
+		int n = seam_offsets[t];
+		for (int k = 0; k < 3; k++) {
+			unsigned int a = corners[3*t+k];
+			unsigned int b = corners[3*t+(k+1)%3];
+			if ((dist[a] < 0 && dist[b] > 0) || (dist[a] > 0 && dist[b] < 0)) {
+				seams[n++] = EdgeKey(a,b);
 			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
-
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(bvert,newPoint1,avert);
-			continue;
 		}
+	}
+	std::sort(seams.begin(), seams.end());
+	seams.erase(std::unique(seams.begin(), seams.end()), seams.end());
+	int num_seams = seams.size();
+	positions.resize(num_vertices + num_seams);
+	#pragma omp parallel for schedule(static) if(parallel)
+	for (int i = 0; i < num_seams; i++) {
+		// (always interpolated from the lower index, so it's computed the
+		// same way whichever triangle asks)
+		unsigned int a = seams[i] >> 32;
+		unsigned int b = seams[i] & 0xffffffffu;
+		float s = dist[a] / (dist[a] - dist[b]);
+		positions[num_vertices+i] = positions[a] + s * (positions[b] - positions[a]);
+	}
 
-		// b is on the plane
-		if (distB == 0) {
-			p1 = cint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(cvert, avert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(cvert, avert, newPoint1);
-			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
-
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(cvert,newPoint1,bvert);
+	// write the pieces of every triangle into the child index arrays
+	std::vector<int> right_offsets, left_offsets;
+	int num_right = ChunkedPrefixSum(right_count, right_offsets, parallel);
+	int num_left = ChunkedPrefixSum(left_count, left_offsets, parallel);
+	std::vector<unsigned int> right_indices(3*num_right), left_indices(3*num_left);
+	#pragma omp parallel for schedule(static, SPLIT_CHUNK) if(parallel)
+	for (int t = 0; t < num_triangles; t++) {
+		const unsigned int *c = &corners[3*t];
+		if (right_count[t] + left_count[t] == 1) {
+			std::vector<unsigned int> &indices = right_count[t] ? right_indices : left_indices;
+			int n = 3 * (right_count[t] ? right_offsets[t] : left_offsets[t]);
+			indices[n] = c[0]; indices[n+1] = c[1]; indices[n+2] = c[2];
 			continue;
 		}
-
-		// c is on the plane
-		if (distC == 0) {
-			p1 = aint;
-
-			// check if a new point along the edge exists already between edges that intersect the plane
-			// if there isn't one already, create that vertex
-			newPoint1 = myMesh.getChildVertex(avert, bvert);
-			if (newPoint1 == NULL) {
-				newPoint1 = myMesh.addVertex(p1);
-				myMesh.setParentsChild(avert, bvert, newPoint1);
+		float d[3] = { dist[c[0]], dist[c[1]], dist[c[2]] };
+		unsigned int polygon[4];
+		for (int side = 0; side < 2; side++) {
+			int n = ClipCorners(c, d, side, seams, num_vertices, polygon);
+			std::vector<unsigned int> &indices = (side == 0) ? right_indices : left_indices;
+			int o = 3 * ((side == 0) ? right_offsets[t] : left_offsets[t]);
+			for (int k = 2; k < n; k++) {
+				indices[o++] = polygon[0];
+				indices[o++] = polygon[k-1];
+				indices[o++] = polygon[k];
 			}
-
-			// remove the intersecting triangle first!
-			myMesh.removeTriangle(t);
-
-			// add these new triangles to the mesh and delete the old one
-			myMesh.addTriangle(avert,newPoint1,cvert);
-			continue;
 		}
 	}
-}
-
-// cuts the mesh along the plane
-void BSPTree::chop(const glm::vec3& normal, float offset) {
-	// printf("begin chop %f %f %f, %f\n", normal.x, normal.y, normal.z, offset);
-	assert(isLeaf());
-	assert(numVertices() > 0);
-	leftChild = new BSPTree(args);
-	rightChild = new BSPTree(args);
-	this->normal = normal;
-	this->offset = offset;
 
-	glm::vec3 pointOnPlane = normal * offset;
-
-	// 2D vector with pointers to the new Vertex in each child mesh
-	// index of the inner vector is corresponds to the index of the vertex from the parent BSPTree mesh
-	std::vector<std::vector<Vertex*> > childVertices(myMesh.numVertices(), std::vector<Vertex*>(2,NULL));
-
-	// vector of triangles that intersect the plane, one for each child
-	// holds the pointers to the triangles for that respective mesh
-	std::vector<Triangle*> trianglesToRemoveL;
-	std::vector<Triangle*> trianglesToRemoveR;
-
-	// go through all the triangles and if they are on the right/left side of the cut
-	// put them in the right/left child respectively
-	// if the triangle is intersecting the cut plane, place them in both children
-	for (triangleshashtype::iterator iter = myMesh.triangles.begin();
-       iter != myMesh.triangles.end(); iter++) {
-		Triangle *t = iter->second;
-		Vertex *avert = (*t)[0];
-		Vertex *bvert = (*t)[1];
-		Vertex *cvert = (*t)[2];
-		glm::vec3 a = avert->getPos();
-		glm::vec3 b = bvert->getPos();
-		glm::vec3 c = cvert->getPos();
-
-		float distA = glm::dot(normal, a-pointOnPlane);
-		float distB = glm::dot(normal, b-pointOnPlane);
-		float distC = glm::dot(normal, c-pointOnPlane);
-
-		// triangle to the right of the plane, add to the right child
-		if (distA >= 0 && distB >= 0 && distC >= 0) {
-			// printf("adding right\n");
-			rightChild->addTriangle(avert,bvert,cvert,0,childVertices, true);
-			continue;
-		}
-
-		// triangle to the left of the plane, add to the left child
-		if (distA <= 0 && distB <= 0 && distC <= 0) {
-			// printf("adding left\n");
-			leftChild->addTriangle(avert,bvert,cvert,1,childVertices, true);
-			continue;
-		}
-
-		// printf("adding to both\n");
-		// triangle intersecting the plane, add it to both children and to vector
-		Triangle *RT = rightChild->addTriangle(avert,bvert,cvert,0,childVertices, false);
-		Triangle *LT = leftChild->addTriangle(avert,bvert,cvert,1,childVertices, false);
-
-		trianglesToRemoveR.push_back(RT);
-		trianglesToRemoveL.push_back(LT);
+	std::vector<glm::vec3> right_positions, left_positions;
+	CompactChild(positions, right_indices, right_positions, parallel);
+	CompactChild(positions, left_indices, left_positions, parallel);
+	#pragma omp parallel sections if(parallel)
+	{
+		#pragma omp section
+		right.Build(right_positions.data(), right_positions.size(), right_indices.data(), num_right);
+		#pragma omp section
+		left.Build(left_positions.data(), left_positions.size(), left_indices.data(), num_left);
 	}
 
-	assert(rightChild->numVertices() > 0);
-	assert(leftChild->numVertices() > 0);
-
-	// cut the triangles in each child mesh that cross the plane
-	rightChild->pruneChildMesh(normal, offset, trianglesToRemoveR);
-	leftChild->pruneChildMesh(-normal, -offset, trianglesToRemoveL);
-
-	assert(rightChild->numVertices() > 0);
-	assert(leftChild->numVertices() > 0);
+	assert(right.numVertices() > 0);
+	assert(left.numVertices() > 0);
 }
 
 // finds the largest partition and returns the number of printing volumes
@@ -460,23 +355,24 @@ int BSPTree::largestPart(float width, float height, float length, BSPTree* &lp)
 	return numPartsRight;
 }
 
-	void BSPTree::getMinMaxOffsetsAlongNorm(const glm::vec3 &normal, float &minOffset, float &maxOffset) {
-		assert(myMesh.numVertices() > 0);
+// extent of the (non-pruned) vertices of mesh along normal
+void BSPTree::getMinMaxOffsetsAlongNorm(const Mesh &mesh, const glm::vec3 &normal, float &minOffset, float &maxOffset) {
+	assert(mesh.numVertices() > 0);
 
-		edgeshashtype::iterator iter = myMesh.edges.begin();
+	edgeshashtype::const_iterator iter = mesh.edges.begin();
 
-		minOffset = glm::dot(normal, (*iter).second->getStartVertex()->getPos());
-		maxOffset = glm::dot(normal, (*iter).second->getStartVertex()->getPos());
-		iter++;
+	minOffset = glm::dot(normal, (*iter).second->getStartVertex()->getPos());
+	maxOffset = glm::dot(normal, (*iter).second->getStartVertex()->getPos());
+	iter++;
 
-		for (; iter != myMesh.edges.end(); ++iter) {
-			float off = glm::dot(normal, (*iter).second->getStartVertex()->getPos());
-			if (off < minOffset) {
-				minOffset = off;
-			}
+	for (; iter != mesh.edges.end(); ++iter) {
+		float off = glm::dot(normal, (*iter).second->getStartVertex()->getPos());
+		if (off < minOffset) {
+			minOffset = off;
+		}
 
-			if (off > maxOffset) {
-				maxOffset = off;
-			}
+		if (off > maxOffset) {
+			maxOffset = off;
 		}
 	}
+}
@@ -3,33 +3,45 @@
 
 #include <cstdlib>
 #include <vector>
+#include <utility>
 #include "glCanvas.h"
 #include "mesh.h"
 
 // A hierarchical spatial data structure to store partitions of our mesh.
 
+// meshes with at least this many triangles are split on all the
+// OpenMP threads (smaller ones on one)
+#ifndef BSP_PARALLEL_SPLIT_TRIANGLES
+#define BSP_PARALLEL_SPLIT_TRIANGLES 20000
+#endif
+
 class BSPTree {
 public:
 	BSPTree() {
 		args = NULL;
 		depth = 0;
+		grade = 0;
 		leftChild = NULL;
 		rightChild = NULL;
 	}
 	BSPTree(ArgParser *_args, unsigned int _depth = 0) : myMesh(_args) {
 		args = _args;
 		depth = _depth;
+		grade = 0;
 		leftChild = NULL;
 		rightChild = NULL;
 	}
 
 	// copy constructor
 	BSPTree(const BSPTree &tree);
+	// move constructor (takes over the children & mesh of tree)
+	BSPTree(BSPTree &&tree);
 
 	~BSPTree();
 
-	// assignment operator
+	// assignment operators
 	BSPTree& operator= (const BSPTree& tree);
+	BSPTree& operator= (BSPTree&& tree);
 
 	// ACCESSORS
 	const glm::vec3& getNormal() const { return normal; }
@@ -42,6 +54,16 @@ public:
 	}
 	float getGrade() const { return grade; }
 	int numVertices() const { return myMesh.numVertices(); }
+	const Mesh& getMesh() const { return myMesh; }
+	// collects the leaf nodes (the final partitions), left to right
+	void getLeaves(std::vector<BSPTree*> &leaves) {
+		if (isLeaf()) {
+			leaves.push_back(this);
+			return;
+		}
+		leftChild->getLeaves(leaves);
+		rightChild->getLeaves(leaves);
+	}
 	glm::vec3 getBoundingBoxDims() {
 		BSPTree* p = NULL;
 		this->largestPart(args->printing_width, args->printing_height, args->printing_length, p);
@@ -52,41 +74,15 @@ public:
 	void setNormal(const glm::vec3& n) { normal = n; }
 	void setOffset(float o) { offset = o; }
 	void setGrade(float g) { grade = g; }
+	// hands the mesh over to / takes it back from another owner
+	void setMesh(Mesh &&mesh) { myMesh = std::move(mesh); }
+	Mesh takeMesh() { return std::move(myMesh); }
+	// (for interior nodes, whose meshes are cleared)
+	void setBoundingBox(const glm::vec3 &min, const glm::vec3 &max) { myMesh.bbox.Set(min, max); }
 
 	// SPECIAL FUNCTIONS
 	void Load() { myMesh.Load(); }
 	const BoundingBox& getBoundingBox() const { return myMesh.getBoundingBox(); }
-	void initializeVBOs() {
-		printf("INIALIZE VBOS\n");
-		if (isLeaf()) {
-			myMesh.initializeVBOs();
-		}
-		if (leftChild != NULL) { leftChild->initializeVBOs(); }
-		if (rightChild != NULL) { rightChild->initializeVBOs(); }
-	}
-	void setupVBOs() {
-		printf("SETUP VBOS\n");
-		if (isLeaf()) {
-			myMesh.setupVBOs();
-		}
-		if (leftChild != NULL) { leftChild->setupVBOs(); }
-		if (rightChild != NULL) { rightChild->setupVBOs(); }
-	}
-	void drawVBOs() {
-		// printf("DRAW VBOS\n");
-		if (isLeaf()) {
-			myMesh.drawVBOs();
-			return;
-		}
-
-		leftChild->drawVBOs();
-		rightChild->drawVBOs();
-	}
-	void cleanupVBOs() {
-		myMesh.cleanupVBOs();
-		if (leftChild != NULL) { leftChild->cleanupVBOs(); }
-		if (rightChild != NULL) { rightChild->cleanupVBOs(); }
-	}
 	glm::vec3 LightPosition() const { return myMesh.LightPosition(); }
 
 	void clearNonLeaves() {
@@ -100,6 +96,9 @@ public:
 	// ===============
 	// CUTTING MESH FUNCTIONS
 	void chop(const glm::vec3& normal, float offset);
+	// the geometry of chop, without a tree: splits mesh into the empty
+	// left & right meshes (mesh is only read)
+	static void SplitMesh(const Mesh& mesh, const glm::vec3& normal, float offset, Mesh& left, Mesh& right);
 
 	// ===============
 	// VOLUME FUNCTIONS (dealing with printing volume)
@@ -113,7 +112,7 @@ public:
 		return leftChild->fitsInVolume(width, height, length) && rightChild->fitsInVolume(width, height, length);
 	}
 	int largestPart(float width, float height, float length, BSPTree* &lp);
-	void getMinMaxOffsetsAlongNorm(const glm::vec3 &normal, float &minOffset, float &maxOffset);
+	static void getMinMaxOffsetsAlongNorm(const Mesh &mesh, const glm::vec3 &normal, float &minOffset, float &maxOffset);
 
 	// ===============
 	// OBJECTIVE functions
@@ -146,10 +145,6 @@ public:
 	BSPTree* rightChild;
 
 private:
-	float CastRay(const glm::vec3& dir, const glm::vec3& origin, const glm::vec3& normal, float offset) const;
-	Triangle* addTriangle(Vertex* a, Vertex* b, Vertex* c, int side, std::vector<std::vector<Vertex*> >& childVertices, bool addToBoundingBox);
-	void pruneChildMesh(const glm::vec3& normal, float offset, std::vector<Triangle*>& trianglesToRemove);
-
 	int getTotalPrintVolumes() {
 		// printf("GET TOTAL PRINT VOLUMES");
 		// gets the total number of print volumes that can fit in all the partitions seperately
@@ -175,12 +170,4 @@ private:
 	float grade;
 };
 
-// class to compare BSPTrees based on their objective function grade
-class BSPTreeGreaterThan {
-public:
-	bool operator() (BSPTree* lhs, BSPTree* rhs) const {
-		return lhs->getGrade() > rhs->getGrade();
-	}
-};
-
 #endif
@@ -34,8 +34,15 @@ PerspectiveCamera::PerspectiveCamera
 // Construct the ViewMatrix & ProjectionMatrix for GL Rendering
 // ====================================================================
 
-void OrthographicCamera::glPlaceCamera() {
-  glfwGetWindowSize(GLCanvas::window, &width, &height);
+void Camera::glPlaceCamera() {
+  int w, h;
+  glfwGetWindowSize(GLCanvas::window, &w, &h);
+  placeCamera(w, h);
+}
+
+void OrthographicCamera::placeCamera(int _width, int _height) {
+  width = _width;
+  height = _height;
   float aspect = width / (float)height;
   float w;
   float h;
@@ -51,8 +58,9 @@ void OrthographicCamera::glPlaceCamera() {
   ViewMatrix =  glm::lookAt(camera_position,point_of_interest,getScreenUp()) ;
 }
 
-void PerspectiveCamera::glPlaceCamera() {
-  glfwGetWindowSize(GLCanvas::window, &width, &height);
+void PerspectiveCamera::placeCamera(int _width, int _height) {
+  width = _width;
+  height = _height;
   float aspect = width / (float)height;
   // must convert angle from degrees to radians
   ProjectionMatrix = glm::perspective<float>(glm::radians(angle), aspect, 0.1f, 1000.0f);
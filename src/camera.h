@@ -19,7 +19,9 @@ public:
   virtual ~Camera() {}
 
   // GL NAVIGATION
-  virtual void glPlaceCamera() = 0;
+  // (the matrices for the window / for an image of width x height)
+  void glPlaceCamera();
+  virtual void placeCamera(int width, int height) = 0;
   void dollyCamera(float dist);
   virtual void zoomCamera(float dist) = 0;
   void truckCamera(float dx, float dy);
@@ -67,7 +69,7 @@ public:
 		     float s=100);  
 
   // GL NAVIGATION
-  void glPlaceCamera();
+  void placeCamera(int width, int height);
   void zoomCamera(float factor);
 
   friend std::ostream& operator<< (std::ostream& ostr, const OrthographicCamera &c);
@@ -89,7 +91,7 @@ public:
 		    float a = 45);
 
   // GL NAVIGATION
-  void glPlaceCamera();
+  void placeCamera(int width, int height);
   void zoomCamera(float dist);
 
   friend std::ostream& operator<< (std::ostream& ostr, const PerspectiveCamera &c);
@@ -0,0 +1,74 @@
+#include <cassert>
+#include <limits>
+#include <algorithm>
+
+#include "cutcollector.h"
+
+// order of the candidates within a group, best first
+static bool CutBefore(const CutCandidate &a, const CutCandidate &b) {
+  if (a.grade != b.grade) return a.grade < b.grade;
+  return a.order < b.order;
+}
+
+// lowers cutoff to value (if that's lower)
+static void LowerCutoff(std::atomic<float> &cutoff, float value) {
+  float current = cutoff.load();
+  while (value < current && !cutoff.compare_exchange_weak(current, value)) {}
+}
+
+// ======================================================================
+
+CutCollector::CutCollector(unsigned int num_groups, unsigned int _k, unsigned int _reserve)
+  : global_cutoff(std::numeric_limits<float>::infinity()) {
+  assert (_k > 0);
+  k = _k;
+  reserve = _reserve;
+  for (unsigned int i = 0; i < num_groups; i++) {
+    Group *g = new Group();
+    g->full_cutoff = std::numeric_limits<float>::infinity();
+    g->reserve_cutoff = (reserve > 0) ? std::numeric_limits<float>::infinity()
+                                      : -std::numeric_limits<float>::infinity();
+    groups.push_back(std::unique_ptr<Group>(g));
+  }
+}
+
+bool CutCollector::Accepts(unsigned int group, float grade) const {
+  assert (group < groups.size());
+  const Group &g = *groups[group];
+  if (grade > g.full_cutoff) return false;
+  return grade <= global_cutoff || grade <= g.reserve_cutoff;
+}
+
+void CutCollector::Insert(unsigned int group, CutCandidate &&c) {
+  if (!Accepts(group, c.grade)) return;
+  Group &g = *groups[group];
+  std::lock_guard<std::mutex> lock(g.mutex);
+  std::vector<CutCandidate>::iterator pos =
+    std::upper_bound(g.cuts.begin(), g.cuts.end(), c, CutBefore);
+  g.cuts.insert(pos, std::move(c));
+  if (g.cuts.size() > k + reserve) {
+    g.cuts.pop_back();
+  }
+  if (g.cuts.size() == k + reserve) {
+    g.full_cutoff = g.cuts.back().grade;
+  }
+  if (reserve > 0 && g.cuts.size() >= reserve) {
+    g.reserve_cutoff = g.cuts[reserve-1].grade;
+  }
+  if (g.cuts.size() >= k) {
+    LowerCutoff(global_cutoff, g.cuts[k-1].grade);
+  }
+}
+
+void CutCollector::Take(unsigned int group, std::vector<CutCandidate> &cuts) {
+  assert (group < groups.size());
+  Group &g = *groups[group];
+  std::lock_guard<std::mutex> lock(g.mutex);
+  // (the reserve of the group, & whatever else could be in the best k)
+  for (unsigned int i = 0; i < g.cuts.size(); i++) {
+    if (i < reserve || g.cuts[i].grade <= global_cutoff) {
+      cuts.push_back(std::move(g.cuts[i]));
+    }
+  }
+  g.cuts.clear();
+}
@@ -0,0 +1,86 @@
+#ifndef _CUT_COLLECTOR_H_
+#define _CUT_COLLECTOR_H_
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// ======================================================================
+// A candidate cut of the beam search, graded but not yet turned into a
+// tree: the plane and the two halves of the leaf it cuts.
+// ======================================================================
+
+struct CutCandidate {
+  float grade;
+  // position of the cut among the others of its group (breaks ties, so
+  // the order never depends on which thread made the cut)
+  unsigned int order;
+  glm::vec3 normal;
+  float offset;
+  std::unique_ptr<Mesh> left;
+  std::unique_ptr<Mesh> right;
+};
+
+// ======================================================================
+// Collects the candidate cuts of one search iteration from many threads
+// and keeps only those that can still matter: the best k of all groups
+// (k = beam width), plus a reserve of the best few of every group so
+// the diversity filter has something to choose from.  Lower grades are
+// better.
+//
+// Every group (one beam tree & normal) is a short sorted list with its
+// own lock.  The cutoffs an insert is checked against are atomics, so a
+// losing candidate is rejected without taking any lock, and the lists
+// never grow past k + reserve entries.  Rejecting early only drops
+// candidates Take() would drop as well, so what it returns doesn't
+// depend on the order of the inserts.  The diversity filter runs on
+// what Take() returns, so it never sees a candidate past the best
+// k + reserve of its group, even one it would have kept.
+// ======================================================================
+
+class CutCollector {
+
+public:
+
+  CutCollector(unsigned int num_groups, unsigned int k, unsigned int reserve);
+
+  unsigned int numGroups() const { return groups.size(); }
+
+  // keeps c if it can still make the cut, frees it otherwise
+  void Insert(unsigned int group, CutCandidate &&c);
+  // moves the surviving candidates of group to cuts, best first
+  // (only once all the inserts are done)
+  void Take(unsigned int group, std::vector<CutCandidate> &cuts);
+
+private:
+
+  CutCollector(const CutCollector&) = delete;
+  CutCollector& operator=(const CutCollector&) = delete;
+
+  // false if a candidate of group with this grade would be dropped
+  bool Accepts(unsigned int group, float grade) const;
+
+  struct Group {
+    std::mutex mutex;
+    // best first, by grade then order
+    std::vector<CutCandidate> cuts;
+    // grade of the worst entry once the list is full & of the last
+    // reserve entry (anything worse than both cutoffs is dropped)
+    std::atomic<float> full_cutoff;
+    std::atomic<float> reserve_cutoff;
+  };
+
+  // ==============
+  // REPRESENTATION
+  std::vector<std::unique_ptr<Group> > groups;
+  unsigned int k;
+  unsigned int reserve;
+  // the lowest k-th best grade of any group
+  std::atomic<float> global_cutoff;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#include "bsptree.h"
+#include "cutplan.h"
+
+static const char cut_plan_magic[8] = { 'A','C','G','P','L','A','N','\0' };
+
+// the on-disk layout of a node
+struct CutPlanRecord {
+  float normal[3];
+  float offset;
+  float grade;
+  unsigned int depth;
+  int left;
+  int right;
+};
+
+struct CutPlanHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int num_nodes;
+  unsigned long long mesh_hash;
+};
+
+// ======================================================================
+
+void CutPlan::FromTree(BSPTree *tree) {
+  assert (tree != NULL);
+  nodes.clear();
+  num_parts = 0;
+  mesh_hash = tree->getMesh().getSourceHash();
+  AddNode(tree);
+}
+
+int CutPlan::AddNode(BSPTree *tree) {
+  int index = nodes.size();
+  nodes.push_back(CutPlanNode());
+  nodes[index].depth = tree->getDepth();
+  nodes[index].grade = tree->getGrade();
+  if (tree->isLeaf()) {
+    nodes[index].normal = glm::vec3(0,0,0);
+    nodes[index].offset = 0;
+    nodes[index].left = nodes[index].right = -1;
+    nodes[index].part = num_parts++;
+    return index;
+  }
+  nodes[index].normal = tree->getNormal();
+  nodes[index].offset = tree->getOffset();
+  nodes[index].part = -1;
+  // (nodes may be reallocated by the recursion, don't hold references)
+  int left = AddNode(tree->leftChild);
+  int right = AddNode(tree->rightChild);
+  nodes[index].left = left;
+  nodes[index].right = right;
+  return index;
+}
+
+// ======================================================================
+
+bool CutPlan::Save(const std::string &filename) const {
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (fp == NULL) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  bool ok = Write(fp);
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) {
+    std::cout << "ERROR! CANNOT WRITE CUT PLAN '" << filename << "'\n";
+  }
+  return ok;
+}
+
+bool CutPlan::Load(const std::string &filename) {
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (fp == NULL) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  bool ok = Read(fp);
+  fclose(fp);
+  if (!ok) {
+    std::cout << "ERROR! BAD CUT PLAN FILE '" << filename << "'\n";
+  }
+  return ok;
+}
+
+bool CutPlan::Write(FILE *fp) const {
+  CutPlanHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, cut_plan_magic, 8);
+  header.version = CUT_PLAN_VERSION;
+  header.num_nodes = nodes.size();
+  header.mesh_hash = mesh_hash;
+  std::vector<CutPlanRecord> records(nodes.size());
+  for (unsigned int i = 0; i < nodes.size(); i++) {
+    for (int j = 0; j < 3; j++) {
+      records[i].normal[j] = nodes[i].normal[j];
+    }
+    records[i].offset = nodes[i].offset;
+    records[i].grade = nodes[i].grade;
+    records[i].depth = nodes[i].depth;
+    records[i].left = nodes[i].left;
+    records[i].right = nodes[i].right;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  if (!records.empty()) {
+    ok = ok && fwrite(records.data(), sizeof(CutPlanRecord), records.size(), fp) == records.size();
+  }
+  return ok;
+}
+
+bool CutPlan::Read(FILE *fp) {
+  nodes.clear();
+  num_parts = 0;
+  mesh_hash = 0;
+  CutPlanHeader header;
+  bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+    memcmp(header.magic, cut_plan_magic, 8) == 0 &&
+    header.version == CUT_PLAN_VERSION &&
+    header.num_nodes > 0 && header.num_nodes < (1u << 24);
+  std::vector<CutPlanRecord> records;
+  if (ok) {
+    records.resize(header.num_nodes);
+    ok = fread(records.data(), sizeof(CutPlanRecord), records.size(), fp) == records.size();
+  }
+  // every child must come after its parent, which also rules out cycles
+  for (unsigned int i = 0; ok && i < records.size(); i++) {
+    const CutPlanRecord &r = records[i];
+    bool leaf = (r.left == -1 && r.right == -1);
+    ok = leaf || (r.left > (int)i && r.left < (int)records.size() &&
+                  r.right > (int)i && r.right < (int)records.size());
+  }
+  if (!ok) {
+    return false;
+  }
+  mesh_hash = header.mesh_hash;
+  nodes.resize(records.size());
+  for (unsigned int i = 0; i < records.size(); i++) {
+    nodes[i].normal = glm::vec3(records[i].normal[0], records[i].normal[1], records[i].normal[2]);
+    nodes[i].offset = records[i].offset;
+    nodes[i].grade = records[i].grade;
+    nodes[i].depth = records[i].depth;
+    nodes[i].left = records[i].left;
+    nodes[i].right = records[i].right;
+    nodes[i].part = (records[i].left == -1) ? num_parts++ : -1;
+  }
+  return true;
+}
+
+// ======================================================================
+
+void CutPlan::Replay(BSPTree *tree) const {
+  assert (tree != NULL && tree->isLeaf());
+  assert (!nodes.empty());
+  ReplayNode(tree, 0);
+  // like the trees kept by the beam search, only the leaves hold meshes
+  tree->clearNonLeaves();
+}
+
+void CutPlan::ReplayNode(BSPTree *tree, int node) const {
+  const CutPlanNode &n = nodes[node];
+  tree->setGrade(n.grade);
+  if (n.left == -1) return;
+  tree->chop(n.normal, n.offset);
+  ReplayNode(tree->leftChild, n.left);
+  ReplayNode(tree->rightChild, n.right);
+}
@@ -0,0 +1,86 @@
+#ifndef _CUT_PLAN_H_
+#define _CUT_PLAN_H_
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+class BSPTree;
+
+// ======================================================================
+// The cutting planes of a finished BSPTree, without any of its meshes.
+// Nodes are stored depth first (node 0 is the root, a node's left
+// subtree comes before its right subtree), so the leaves appear in the
+// same order as BSPTree::getLeaves returns them.  Like BSPTree::chop,
+// a point p is on the right (front) side of a node's plane when
+//   dot(normal, p - normal*offset) >= 0
+//
+// A plan can be saved & loaded (a small binary file, 32 bytes per node)
+// and replayed on the mesh it was made for, which rebuilds the
+// partitions with one chop per node instead of a search.  The plan
+// remembers the hash of that mesh's file (see Mesh::getSourceHash).
+// ======================================================================
+
+#define CUT_PLAN_VERSION 1
+
+struct CutPlanNode {
+  glm::vec3 normal;
+  float offset;
+  unsigned int depth;
+  // objective function grade of the tree when this node was cut
+  float grade;
+  // children (indices into the plan), -1 for a leaf
+  int left;
+  int right;
+  // the number of the part, -1 for an interior node
+  int part;
+};
+
+class CutPlan {
+
+public:
+
+  CutPlan() { num_parts = 0; mesh_hash = 0; }
+
+  // flattens the planes of tree
+  void FromTree(BSPTree *tree);
+
+  bool Save(const std::string &filename) const;
+  bool Load(const std::string &filename);
+  // the same, at the current position of an open (binary) file
+  bool Write(FILE *fp) const;
+  bool Read(FILE *fp);
+
+  // cuts tree (a leaf holding the mesh the plan was made for) with every
+  // plane of the plan & restores the grades, no search involved
+  void Replay(BSPTree *tree) const;
+
+  // =========
+  // ACCESSORS
+  int numNodes() const { return nodes.size(); }
+  int numParts() const { return num_parts; }
+  unsigned long long getMeshHash() const { return mesh_hash; }
+  const CutPlanNode& getNode(int i) const {
+    assert (i >= 0 && i < (int)nodes.size()); return nodes[i]; }
+  bool isLeaf(int i) const { return getNode(i).left == -1; }
+  // signed distance of p from the plane of interior node i
+  float Distance(int i, const glm::vec3 &p) const {
+    const CutPlanNode &n = getNode(i);
+    return glm::dot(n.normal, p - n.normal * n.offset);
+  }
+
+private:
+
+  int AddNode(BSPTree *tree);
+  void ReplayNode(BSPTree *tree, int node) const;
+
+  // ==============
+  // REPRESENTATION
+  std::vector<CutPlanNode> nodes;
+  int num_parts;
+  unsigned long long mesh_hash;
+};
+
+#endif
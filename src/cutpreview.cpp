@@ -0,0 +1,219 @@
+#include <cassert>
+#include <limits>
+#include <algorithm>
+
+#include "cutpreview.h"
+#include "bsptree.h"
+#include "mesh.h"
+#include "vertex.h"
+#include "argparser.h"
+
+// ======================================================================
+
+CutPreview::CutPreview(ArgParser *_args, BSPTree *tree, BSPTree *_leaf) {
+  args = _args;
+  leaf = _leaf;
+  assert (leaf->isLeaf());
+
+  // the vertices the edges use, numbered compactly
+  const Mesh &mesh = leaf->getMesh();
+  std::vector<unsigned int> ends;
+  mesh.getEdgeEndpoints(ends);
+  std::vector<int> index(mesh.numVertices(), -1);
+  edge_ends.reserve(ends.size());
+  for (unsigned int i = 0; i < ends.size(); i++) {
+    int &k = index[ends[i]];
+    if (k < 0) {
+      k = positions.size();
+      positions.push_back(mesh.getVertex(ends[i])->getPos());
+    }
+    edge_ends.push_back(k);
+  }
+  assert (!positions.empty());
+
+  // the other leaves don't change while the plane moves
+  float width = args->printing_width;
+  float height = args->printing_height;
+  float length = args->printing_length;
+  float printingVolume = width * height * length;
+  root_print_volumes = tree->getMesh().numPrintVolumes(width, height, length);
+  other_print_volumes = 0;
+  other_util = -std::numeric_limits<float>::infinity();
+  std::vector<BSPTree*> leaves;
+  tree->getLeaves(leaves);
+  for (unsigned int i = 0; i < leaves.size(); i++) {
+    if (leaves[i] == leaf) continue;
+    const Mesh &m = leaves[i]->getMesh();
+    int pv = m.numPrintVolumes(width, height, length);
+    other_print_volumes += pv;
+    other_util = std::max(other_util, 1 - m.getBBVolume() / (pv * printingVolume));
+  }
+
+  normal_index = 0;
+  current = NULL;
+  offset = 0;
+  lo_count = hi_count = 0;
+  cuts = false;
+  part = util = 0;
+}
+
+// ======================================================================
+
+void CutPreview::Sort(Projection &p) const {
+  const glm::vec3 empty_min(std::numeric_limits<float>::infinity());
+  const glm::vec3 empty_max(-std::numeric_limits<float>::infinity());
+
+  // the vertices along the normal, with the boxes of both ends
+  unsigned int n = positions.size();
+  std::vector<float> proj(n);
+  std::vector<unsigned int> order(n);
+  for (unsigned int i = 0; i < n; i++) {
+    proj[i] = glm::dot(p.normal, positions[i]);
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&proj](unsigned int a, unsigned int b) { return proj[a] < proj[b]; });
+  p.vert_proj.resize(n);
+  p.below_min.assign(n + 1, empty_min);
+  p.below_max.assign(n + 1, empty_max);
+  p.above_min.assign(n + 1, empty_min);
+  p.above_max.assign(n + 1, empty_max);
+  for (unsigned int i = 0; i < n; i++) {
+    const glm::vec3 &pos = positions[order[i]];
+    p.vert_proj[i] = proj[order[i]];
+    p.below_min[i+1] = glm::min(p.below_min[i], pos);
+    p.below_max[i+1] = glm::max(p.below_max[i], pos);
+  }
+  for (unsigned int i = n; i > 0; i--) {
+    const glm::vec3 &pos = positions[order[i-1]];
+    p.above_min[i-1] = glm::min(p.above_min[i], pos);
+    p.above_max[i-1] = glm::max(p.above_max[i], pos);
+  }
+
+  // the edges by either end
+  unsigned int num_edges = edge_ends.size() / 2;
+  p.edge_lo.resize(num_edges);
+  p.edge_hi.resize(num_edges);
+  p.by_lo.resize(num_edges);
+  p.by_hi.resize(num_edges);
+  for (unsigned int e = 0; e < num_edges; e++) {
+    float a = proj[edge_ends[2*e]];
+    float b = proj[edge_ends[2*e+1]];
+    p.edge_lo[e] = std::min(a, b);
+    p.edge_hi[e] = std::max(a, b);
+    p.by_lo[e] = p.by_hi[e] = e;
+  }
+  const std::vector<float> &lo = p.edge_lo;
+  const std::vector<float> &hi = p.edge_hi;
+  std::sort(p.by_lo.begin(), p.by_lo.end(),
+            [&lo](unsigned int a, unsigned int b) { return lo[a] < lo[b]; });
+  std::sort(p.by_hi.begin(), p.by_hi.end(),
+            [&hi](unsigned int a, unsigned int b) { return hi[a] > hi[b]; });
+}
+
+void CutPreview::setNormal(unsigned int n, const glm::vec3 &normal) {
+  if (n >= projections.size()) projections.resize(n + 1);
+  if (projections[n] == nullptr) {
+    Projection *p = new Projection();
+    p->normal = normal;
+    Sort(*p);
+    projections[n].reset(p);
+  }
+  normal_index = n;
+  current = projections[n].get();
+
+  // start with the plane below the leaf (nothing crosses it), then move
+  // it to the middle
+  offset = current->vert_proj.front();
+  band.clear();
+  lo_count = 0;
+  hi_count = 0;
+  while (hi_count < current->by_hi.size() &&
+         current->edge_hi[current->by_hi[hi_count]] > offset) {
+    hi_count++;
+  }
+  setOffset(0.5f * (getMinOffset() + getMaxOffset()));
+}
+
+// ======================================================================
+
+void CutPreview::setOffset(float d) {
+  assert (current != NULL);
+  const Projection &p = *current;
+  unsigned int num_edges = p.edge_lo.size();
+
+  // the edges whose lower (moving up) or upper (moving down) end the
+  // plane passed may now cross it
+  if (d > offset) {
+    while (lo_count < num_edges && p.edge_lo[p.by_lo[lo_count]] < d) {
+      unsigned int e = p.by_lo[lo_count++];
+      if (p.edge_hi[e] > d) band.push_back(e);
+    }
+    while (hi_count > 0 && p.edge_hi[p.by_hi[hi_count-1]] <= d) hi_count--;
+  } else if (d < offset) {
+    while (hi_count < num_edges && p.edge_hi[p.by_hi[hi_count]] > d) {
+      unsigned int e = p.by_hi[hi_count++];
+      if (p.edge_lo[e] < d) band.push_back(e);
+    }
+    while (lo_count > 0 && p.edge_lo[p.by_lo[lo_count-1]] >= d) lo_count--;
+  }
+  offset = d;
+  // (and the ones the plane left behind don't)
+  unsigned int k = 0;
+  for (unsigned int i = 0; i < band.size(); i++) {
+    unsigned int e = band[i];
+    if (p.edge_lo[e] < d && p.edge_hi[e] > d) band[k++] = e;
+  }
+  band.resize(k);
+
+  unsigned int n = p.vert_proj.size();
+  cuts = (p.vert_proj.front() < d && d < p.vert_proj.back());
+  if (!cuts) {
+    // the leaf stays whole
+    Grade(p.below_min[n], p.below_max[n], glm::vec3(0), glm::vec3(0));
+    return;
+  }
+
+  // the vertices on either side (chop puts the ones on the plane in both)
+  unsigned int below = std::upper_bound(p.vert_proj.begin(), p.vert_proj.end(), d) - p.vert_proj.begin();
+  unsigned int above = std::lower_bound(p.vert_proj.begin(), p.vert_proj.end(), d) - p.vert_proj.begin();
+  glm::vec3 left_min = p.below_min[below];
+  glm::vec3 left_max = p.below_max[below];
+  glm::vec3 right_min = p.above_min[above];
+  glm::vec3 right_max = p.above_max[above];
+  // and where the band meets the plane
+  for (unsigned int i = 0; i < band.size(); i++) {
+    const glm::vec3 &a = positions[edge_ends[2*band[i]]];
+    const glm::vec3 &b = positions[edge_ends[2*band[i]+1]];
+    float da = glm::dot(p.normal, a);
+    float db = glm::dot(p.normal, b);
+    glm::vec3 x = a + (b - a) * ((d - da) / (db - da));
+    left_min = glm::min(left_min, x);
+    left_max = glm::max(left_max, x);
+    right_min = glm::min(right_min, x);
+    right_max = glm::max(right_max, x);
+  }
+  Grade(left_min, left_max, right_min, right_max);
+}
+
+void CutPreview::Grade(const glm::vec3 &left_min, const glm::vec3 &left_max,
+                       const glm::vec3 &right_min, const glm::vec3 &right_max) {
+  float width = args->printing_width;
+  float height = args->printing_height;
+  float length = args->printing_length;
+  float printingVolume = width * height * length;
+  int total = other_print_volumes;
+  util = other_util;
+  // (the right half is unused when the plane misses the leaf)
+  for (int side = 0; side < (cuts ? 2 : 1); side++) {
+    glm::vec3 dims = (side == 0) ? left_max - left_min : right_max - right_min;
+    int pv = Mesh::NumPrintVolumes(dims, width, height, length);
+    total += pv;
+    util = std::max(util, 1 - (dims.x * dims.y * dims.z) / (pv * printingVolume));
+  }
+  part = (1.0f / root_print_volumes) * total;
+}
+
+float CutPreview::getGrade() const {
+  return args->a_part*fPart() + args->a_util*fUtil();
+}
@@ -0,0 +1,113 @@
+#ifndef _CUT_PREVIEW_H_
+#define _CUT_PREVIEW_H_
+
+#include <vector>
+#include <memory>
+#include <glm/glm.hpp>
+
+class ArgParser;
+class BSPTree;
+
+// ======================================================================
+// The objective of cutting one leaf of a tree along a plane that is
+// being dragged around, updated every time the plane moves & without
+// splitting the mesh.
+//
+// The grade only depends on the bounding boxes of the two halves: the
+// vertices on each side plus the points where the edges crossing the
+// plane meet it.  For every normal used, the vertices are sorted along
+// it with the bounding boxes of every prefix & suffix, so the vertex
+// part of either half is a binary search away.  The edges crossing the
+// plane (the band) are kept up to date as it moves: the edges are
+// sorted by both ends along the normal, and only the edges the plane
+// passed an end of since the last offset are looked at.  Moving the
+// plane costs about the size of the band, not of the mesh.
+//
+// (the halves chop() makes can differ a little for vertices lying
+// exactly on the plane)
+// ======================================================================
+
+class CutPreview {
+
+public:
+
+  // previews cuts of leaf, a leaf of tree (both must stay unchanged
+  // while the preview is used)
+  CutPreview(ArgParser *args, BSPTree *tree, BSPTree *leaf);
+
+  BSPTree* getLeaf() const { return leaf; }
+
+  // the plane is normal . p = offset (normal is a unit vector); n
+  // identifies the normal, the sorted projections are kept for every n
+  // used
+  void setNormal(unsigned int n, const glm::vec3 &normal);
+  void setOffset(float offset);
+  unsigned int getNormalIndex() const { return normal_index; }
+  const glm::vec3& getNormal() const { return current->normal; }
+  float getOffset() const { return offset; }
+  // the extent of the leaf along the normal
+  float getMinOffset() const { return current->vert_proj.front(); }
+  float getMaxOffset() const { return current->vert_proj.back(); }
+
+  // false if the plane misses the leaf (the objective is then that of
+  // the uncut tree)
+  bool cutsLeaf() const { return cuts; }
+  float fPart() const { return part; }
+  float fUtil() const { return util; }
+  float getGrade() const;
+  unsigned int bandSize() const { return band.size(); }
+
+private:
+
+  CutPreview(const CutPreview&) = delete;
+  CutPreview& operator=(const CutPreview&) = delete;
+
+  // the leaf sorted along one normal
+  struct Projection {
+    glm::vec3 normal;
+    // (ascending)
+    std::vector<float> vert_proj;
+    // bounding box of the first i / of vertex i on (size + 1 entries)
+    std::vector<glm::vec3> below_min, below_max;
+    std::vector<glm::vec3> above_min, above_max;
+    // lower & upper end of every edge along the normal
+    std::vector<float> edge_lo, edge_hi;
+    // the edges by lower end ascending & by upper end descending
+    std::vector<unsigned int> by_lo, by_hi;
+  };
+
+  void Sort(Projection &p) const;
+  // the objective of the halves with these bounding boxes
+  void Grade(const glm::vec3 &left_min, const glm::vec3 &left_max,
+             const glm::vec3 &right_min, const glm::vec3 &right_max);
+
+  // ==============
+  // REPRESENTATION
+  ArgParser *args;
+  BSPTree *leaf;
+  // the vertices & edges (vertex index pairs) of the leaf
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> edge_ends;
+  // the rest of the tree: print volumes of the whole mesh & of the
+  // other leaves, worst utilization of the other leaves (-infinity =
+  // none)
+  int root_print_volumes;
+  int other_print_volumes;
+  float other_util;
+
+  std::vector<std::unique_ptr<Projection> > projections;
+  unsigned int normal_index;
+  const Projection *current;
+  // the plane & the edges crossing it: by_lo[0, lo_count) start below
+  // offset, by_hi[0, hi_count) end above it
+  float offset;
+  std::vector<unsigned int> band;
+  unsigned int lo_count;
+  unsigned int hi_count;
+
+  bool cuts;
+  float part;
+  float util;
+};
+
+#endif
@@ -0,0 +1,480 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bsptree.h"
+#include "argparser.h"
+#include "exporter.h"
+#include "threadpool.h"
+#include "cutplan.h"
+#include "meshio.h"
+#include "utils.h"
+
+// ======================================================================
+
+std::string OutputPrefix(ArgParser *args) {
+  if (args->output_prefix != "") {
+    return args->output_prefix;
+  }
+  std::string base = args->input_file;
+  size_t dot = base.find_last_of('.');
+  if (dot != std::string::npos) {
+    base = base.substr(0, dot);
+  }
+  return args->path + "/" + base;
+}
+
+static std::string PartFilename(const std::string &prefix, int part, const std::string &format) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "_part%d.", part);
+  return prefix + suffix + format;
+}
+
+static std::string StripPath(const std::string &filename) {
+  size_t slash = filename.find_last_of("/\\");
+  if (slash == std::string::npos) return filename;
+  return filename.substr(slash+1);
+}
+
+// s as a JSON string literal (quoted, with the quotes, backslashes &
+// control characters escaped)
+static std::string JSONString(const std::string &s) {
+  std::string result = "\"";
+  for (unsigned int i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (c < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      result += code;
+    } else {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+// ======================================================================
+
+// one cut on the way from the root to a part
+struct PlaneSide {
+  glm::vec3 normal;
+  float offset;
+  // +1 = in front of the plane (right child), -1 = behind it (left child)
+  int side;
+};
+
+struct Part {
+  // (NULL for streamed parts)
+  BSPTree *leaf;
+  std::vector<PlaneSide> planes;
+  int num_triangles;
+  BoundingBox bbox;
+};
+
+static void CollectParts(BSPTree *node, std::vector<PlaneSide> &history, std::vector<Part> &parts) {
+  if (node->isLeaf()) {
+    Part part;
+    part.leaf = node;
+    part.planes = history;
+    part.num_triangles = node->getMesh().numTriangles();
+    part.bbox = node->getMesh().getBoundingBox();
+    parts.push_back(part);
+    return;
+  }
+  PlaneSide cut;
+  cut.normal = node->getNormal();
+  cut.offset = node->getOffset();
+  cut.side = -1;
+  history.push_back(cut);
+  CollectParts(node->leftChild, history, parts);
+  history.back().side = 1;
+  CollectParts(node->rightChild, history, parts);
+  history.pop_back();
+}
+
+// the same for the parts of a cut plan (bounding boxes & triangle counts
+// are filled in as the triangles are streamed)
+static void CollectParts(const CutPlan &plan, int node, std::vector<PlaneSide> &history,
+                         std::vector<Part> &parts) {
+  const CutPlanNode &n = plan.getNode(node);
+  if (plan.isLeaf(node)) {
+    assert (n.part == (int)parts.size());
+    Part part;
+    part.leaf = NULL;
+    part.planes = history;
+    part.num_triangles = 0;
+    parts.push_back(part);
+    return;
+  }
+  PlaneSide cut;
+  cut.normal = n.normal;
+  cut.offset = n.offset;
+  cut.side = -1;
+  history.push_back(cut);
+  CollectParts(plan, n.left, history, parts);
+  history.back().side = 1;
+  CollectParts(plan, n.right, history, parts);
+  history.pop_back();
+}
+
+static bool WriteManifest(const std::string &filename, const std::string &input,
+                          const std::vector<Part> &parts,
+                          const std::vector<std::string> &part_files, ArgParser *args) {
+  FILE *fp = fopen(filename.c_str(), "w");
+  if (fp == NULL) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"input\": %s,\n", JSONString(input).c_str());
+  fprintf(fp, "  \"printing_size\": [%f, %f, %f],\n",
+          args->printing_width, args->printing_height, args->printing_length);
+  fprintf(fp, "  \"parts\": [\n");
+  for (unsigned int i = 0; i < parts.size(); i++) {
+    const glm::vec3 &bmin = parts[i].bbox.getMin();
+    const glm::vec3 &bmax = parts[i].bbox.getMax();
+    fprintf(fp, "    {\n");
+    fprintf(fp, "      \"file\": %s,\n", JSONString(StripPath(part_files[i])).c_str());
+    fprintf(fp, "      \"triangles\": %d,\n", parts[i].num_triangles);
+    fprintf(fp, "      \"bbox_min\": [%f, %f, %f],\n", bmin.x, bmin.y, bmin.z);
+    fprintf(fp, "      \"bbox_max\": [%f, %f, %f],\n", bmax.x, bmax.y, bmax.z);
+    fprintf(fp, "      \"planes\": [");
+    for (unsigned int j = 0; j < parts[i].planes.size(); j++) {
+      const PlaneSide &p = parts[i].planes[j];
+      fprintf(fp, "%s\n        { \"normal\": [%f, %f, %f], \"offset\": %f, \"side\": %d }",
+              (j == 0) ? "" : ",", p.normal.x, p.normal.y, p.normal.z, p.offset, p.side);
+    }
+    fprintf(fp, "%s]\n", parts[i].planes.empty() ? "" : "\n      ");
+    fprintf(fp, "    }%s\n", (i+1 < parts.size()) ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+  bool ok = !ferror(fp);
+  ok = (fclose(fp) == 0) && ok;
+  return ok;
+}
+
+// ======================================================================
+
+int ExportPartitions(BSPTree *tree, const std::string &prefix,
+                     const std::string &format, ArgParser *args) {
+  assert (tree != NULL);
+  assert (format == "obj" || format == "stl");
+  std::vector<Part> parts;
+  std::vector<PlaneSide> history;
+  CollectParts(tree, history, parts);
+
+  std::vector<std::string> part_files(parts.size());
+  std::vector<char> written(parts.size(), 0);
+  ThreadPool pool(std::min((unsigned int)parts.size(), std::thread::hardware_concurrency()));
+  for (unsigned int i = 0; i < parts.size(); i++) {
+    const Mesh *mesh = &parts[i].leaf->getMesh();
+    part_files[i] = PartFilename(prefix, i, format);
+    std::string filename = part_files[i];
+    char *result = &written[i];
+    bool stl = (format == "stl");
+    pool.Submit([mesh, filename, result, stl]() {
+      *result = stl ? mesh->WriteSTL(filename) : mesh->OutputFile(filename);
+    });
+  }
+  pool.Wait();
+
+  int count = 0;
+  for (unsigned int i = 0; i < parts.size(); i++) {
+    if (written[i]) count++;
+  }
+  if (!WriteManifest(prefix + "_manifest.json", args->input_file, parts, part_files, args)) {
+    std::cout << "ERROR! the manifest '" << prefix << "_manifest.json' wasn't written" << std::endl;
+    return 0;
+  }
+  std::cout << "wrote " << count << " of " << parts.size() << " partitions to "
+            << prefix << "_part*." << format << std::endl;
+  return count;
+}
+
+// ======================================================================
+// STREAMING
+// ======================================================================
+
+// a triangle of the output, the part it belongs to, and which of its
+// corners were made by a cut (rather than being corners of the input)
+struct StreamedTriangle {
+  int part;
+  glm::vec3 corners[3];
+  bool seam[3];
+};
+
+// where the edge (a,b) crosses the plane.  The edge is always walked
+// from the same end, so the two triangles sharing it compute exactly the
+// same (bit identical) seam vertex.
+static glm::vec3 PlaneCrossing(const glm::vec3 &a, float da, const glm::vec3 &b, float db) {
+  if (b.x < a.x || (b.x == a.x && (b.y < a.y || (b.y == a.y && b.z < a.z)))) {
+    return PlaneCrossing(b, db, a, da);
+  }
+  float t = da / (da - db);
+  return a + t * (b - a);
+}
+
+// sends a convex polygon (initially a triangle) down the plan, splitting
+// it at every plane it crosses; the pieces that reach a leaf are
+// triangulated as a fan.  seam flags the corners made by the cuts.
+static void ClipThroughPlan(const CutPlan &plan, int node, const std::vector<glm::vec3> &polygon,
+                            const std::vector<bool> &seam, std::vector<StreamedTriangle> &output) {
+  while (!plan.isLeaf(node)) {
+    int n = polygon.size();
+    float dist[16];
+    std::vector<float> more_dist;
+    float *d = dist;
+    if (n > 16) {
+      more_dist.resize(n);
+      d = more_dist.data();
+    }
+    bool any_left = false;
+    bool any_right = false;
+    for (int i = 0; i < n; i++) {
+      d[i] = plan.Distance(node, polygon[i]);
+      if (d[i] < 0) any_left = true;
+      if (d[i] > 0) any_right = true;
+    }
+    // same rules as BSPTree::chop: touching the plane counts as right
+    if (!any_left) { node = plan.getNode(node).right; continue; }
+    if (!any_right) { node = plan.getNode(node).left; continue; }
+
+    std::vector<glm::vec3> left_polygon;
+    std::vector<glm::vec3> right_polygon;
+    std::vector<bool> left_seam;
+    std::vector<bool> right_seam;
+    for (int i = 0; i < n; i++) {
+      int j = (i+1) % n;
+      if (d[i] <= 0) { left_polygon.push_back(polygon[i]); left_seam.push_back(seam[i]); }
+      if (d[i] >= 0) { right_polygon.push_back(polygon[i]); right_seam.push_back(seam[i]); }
+      if ((d[i] < 0 && d[j] > 0) || (d[i] > 0 && d[j] < 0)) {
+        glm::vec3 p = PlaneCrossing(polygon[i], d[i], polygon[j], d[j]);
+        left_polygon.push_back(p);
+        right_polygon.push_back(p);
+        left_seam.push_back(true);
+        right_seam.push_back(true);
+      }
+    }
+    ClipThroughPlan(plan, plan.getNode(node).left, left_polygon, left_seam, output);
+    ClipThroughPlan(plan, plan.getNode(node).right, right_polygon, right_seam, output);
+    return;
+  }
+  StreamedTriangle t;
+  t.part = plan.getNode(node).part;
+  for (unsigned int i = 2; i < polygon.size(); i++) {
+    t.corners[0] = polygon[0];
+    t.corners[1] = polygon[i-1];
+    t.corners[2] = polygon[i];
+    t.seam[0] = seam[0];
+    t.seam[1] = seam[i-1];
+    t.seam[2] = seam[i];
+    output.push_back(t);
+  }
+}
+
+// exact bit pattern of a position, the key for merging the corners of
+// a streamed part into shared .obj vertices (a seam vertex is computed
+// bit identically by both triangles of the input edge it is on, so its
+// position identifies the edge & the plane)
+struct PositionKey {
+  unsigned int bits[3];
+  bool operator==(const PositionKey &other) const {
+    return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+  }
+};
+
+struct PositionKeyHash {
+  size_t operator()(const PositionKey &k) const {
+    return (size_t)(((unsigned long long)k.bits[0] * 73856093ULL) ^
+                    ((unsigned long long)k.bits[1] * 19349663ULL) ^
+                    ((unsigned long long)k.bits[2] * 83492791ULL));
+  }
+};
+
+// an output file that triangles are appended to as they are streamed.
+// .stl is written as it comes; .obj vertices are written the first time
+// a triangle uses them.  Only the seam vertices are numbered for the
+// whole part, the corners of the input only within a chunk (so one
+// shared by two chunks is written twice, WeldVertices merges them
+// again on loading).
+class StreamedPart {
+public:
+  StreamedPart() { objfile = NULL; stl = false; num_vertices = 0; num_triangles = 0; }
+  ~StreamedPart() { Close(); }
+
+  bool Open(const std::string &filename, bool _stl) {
+    stl = _stl;
+    if (stl) return stl_writer.Open(filename);
+    objfile = fopen(filename.c_str(), "w");
+    if (objfile == NULL) {
+      std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+      return false;
+    }
+    setvbuf(objfile, NULL, _IOFBF, 1 << 20);
+    return true;
+  }
+  void AddTriangle(const StreamedTriangle &t) {
+    const glm::vec3 &a = t.corners[0];
+    const glm::vec3 &b = t.corners[1];
+    const glm::vec3 &c = t.corners[2];
+    if (num_triangles == 0) bbox.Set(a,a);
+    bbox.Extend(a);
+    bbox.Extend(b);
+    bbox.Extend(c);
+    num_triangles++;
+    if (stl) {
+      stl_writer.AddTriangle(ComputeNormal(a,b,c), a, b, c);
+      return;
+    }
+    if (objfile == NULL) return;
+    int ia = VertexNumber(a, t.seam[0]);
+    int ib = VertexNumber(b, t.seam[1]);
+    int ic = VertexNumber(c, t.seam[2]);
+    fprintf(objfile, "f %d %d %d\n", ia, ib, ic);
+  }
+  bool Close() {
+    if (stl) return stl_writer.Close();
+    if (objfile == NULL) return false;
+    bool ok = !ferror(objfile);
+    ok = (fclose(objfile) == 0) && ok;
+    objfile = NULL;
+    seam_numbers.clear();
+    chunk_numbers.clear();
+    return ok;
+  }
+  // the corners of the input seen so far won't be used again
+  void EndChunk() {
+    chunk_numbers.clear();
+  }
+
+  int num_triangles;
+  BoundingBox bbox;
+
+private:
+  int VertexNumber(const glm::vec3 &p, bool seam) {
+    PositionKey key;
+    memcpy(key.bits, &p[0], 12);
+    std::unordered_map<PositionKey,int,PositionKeyHash> &numbers = seam ? seam_numbers : chunk_numbers;
+    std::pair<std::unordered_map<PositionKey,int,PositionKeyHash>::iterator,bool> found =
+      numbers.insert(std::make_pair(key, num_vertices+1));
+    if (found.second) {
+      num_vertices++;
+      fprintf(objfile, "v %.6f %.6f %.6f\n", p.x, p.y, p.z);
+    }
+    return found.first->second;
+  }
+
+  FILE *objfile;
+  STLWriter stl_writer;
+  bool stl;
+  int num_vertices;
+  // vertex numbers of the seam vertices & of the input corners of the
+  // current chunk
+  std::unordered_map<PositionKey,int,PositionKeyHash> seam_numbers;
+  std::unordered_map<PositionKey,int,PositionKeyHash> chunk_numbers;
+};
+
+int StreamPartitions(const std::string &input_file, const CutPlan &plan,
+                     const std::string &prefix, const std::string &format,
+                     size_t chunk_bytes, ArgParser *args) {
+  assert (format == "obj" || format == "stl");
+  TriangleStream input;
+  if (!input.Open(input_file)) {
+    return 0;
+  }
+  std::vector<Part> parts;
+  std::vector<PlaneSide> history;
+  CollectParts(plan, 0, history, parts);
+  int num_parts = parts.size();
+
+  std::vector<std::string> part_files(num_parts);
+  std::vector<StreamedPart> outputs(num_parts);
+  bool ok = true;
+  for (int i = 0; i < num_parts; i++) {
+    part_files[i] = PartFilename(prefix, i, format);
+    ok = outputs[i].Open(part_files[i], format == "stl") && ok;
+  }
+
+  int num_threads = 1;
+#ifdef _OPENMP
+  num_threads = omp_get_max_threads();
+#endif
+  std::vector<std::vector<StreamedTriangle> > pieces(num_threads);
+  std::vector<glm::vec3> corners;
+  long long num_input_triangles = 0;
+  while (ok && input.ReadChunk(chunk_bytes, corners)) {
+    // split the triangles of the chunk in parallel, then append the
+    // pieces to the parts in input order
+    int num_triangles = corners.size() / 3;
+    num_input_triangles += num_triangles;
+    // (the team may be smaller than num_threads, so only the slots of
+    // the threads that ran are merged)
+    for (int i = 0; i < num_threads; i++) {
+      pieces[i].clear();
+    }
+    int team_size = 1;
+    #pragma omp parallel
+    {
+      int thread = 0;
+#ifdef _OPENMP
+      thread = omp_get_thread_num();
+      #pragma omp single
+      team_size = omp_get_num_threads();
+#endif
+      std::vector<StreamedTriangle> &local = pieces[thread];
+      std::vector<glm::vec3> triangle(3);
+      std::vector<bool> seam(3, false);
+      #pragma omp for schedule(static)
+      for (int t = 0; t < num_triangles; t++) {
+        triangle[0] = corners[3*t];
+        triangle[1] = corners[3*t+1];
+        triangle[2] = corners[3*t+2];
+        ClipThroughPlan(plan, 0, triangle, seam, local);
+      }
+    }
+    for (int i = 0; i < team_size; i++) {
+      for (unsigned int j = 0; j < pieces[i].size(); j++) {
+        const StreamedTriangle &t = pieces[i][j];
+        outputs[t.part].AddTriangle(t);
+      }
+    }
+    for (int i = 0; i < num_parts; i++) {
+      outputs[i].EndChunk();
+    }
+  }
+  ok = ok && !input.hadError();
+
+  int count = 0;
+  for (int i = 0; i < num_parts; i++) {
+    if (outputs[i].Close() && ok) count++;
+    parts[i].num_triangles = outputs[i].num_triangles;
+    parts[i].bbox = outputs[i].bbox;
+  }
+  if (!WriteManifest(prefix + "_manifest.json", input_file, parts, part_files, args)) {
+    std::cout << "ERROR! the manifest '" << prefix << "_manifest.json' wasn't written" << std::endl;
+    return 0;
+  }
+  std::cout << "streamed " << num_input_triangles << " triangles into " << count << " of "
+            << num_parts << " partitions " << prefix << "_part*." << format << std::endl;
+  return count;
+}
+
+// ======================================================================
+
+int WritePartitions(BSPTree *tree, ArgParser *args) {
+  if (args->stream_input != "") {
+    CutPlan plan;
+    plan.FromTree(tree);
+    return StreamPartitions(args->stream_input, plan, OutputPrefix(args), args->output_format,
+                            (size_t)args->stream_chunk_mb << 20, args);
+  }
+  return ExportPartitions(tree, OutputPrefix(args), args->output_format, args);
+}
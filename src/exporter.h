@@ -0,0 +1,46 @@
+#ifndef _EXPORTER_H_
+#define _EXPORTER_H_
+
+#include <string>
+
+class ArgParser;
+class BSPTree;
+class CutPlan;
+
+// ======================================================================
+// Writing the partitions (the leaves of the final BSPTree) to disk.
+// Every leaf is written by its own task on a ThreadPool, as an .obj
+// (vertices renumbered per part) or a binary .stl file.  A manifest
+// lists each part with its bounding box and the sequence of cutting
+// planes (and the side of each) that produced it.
+// ======================================================================
+
+// file name prefix for the exported parts: the -output argument, or
+// the input file name without its extension
+std::string OutputPrefix(ArgParser *args);
+
+// writes each leaf as <prefix>_part<N>.<format> ("obj" or "stl") plus
+// <prefix>_manifest.json, returns the number of parts written (0 if
+// the manifest couldn't be written)
+int ExportPartitions(BSPTree *tree, const std::string &prefix,
+                     const std::string &format, ArgParser *args);
+
+// ======================================================================
+// Out-of-core version for meshes too large to load: applies the planes
+// of a finished cut plan to input_file, read chunk_bytes at a time, and
+// streams the pieces straight into the part files.  No half-edge mesh
+// is built; memory is bounded by the chunk plus, for .obj output, the
+// numbers of the vertices made on the cutting planes (so the two input
+// triangles sharing a cut edge share them).  The positions of an .obj
+// input are paged in from a temporary file (see TriangleStream).
+// ======================================================================
+
+int StreamPartitions(const std::string &input_file, const CutPlan &plan,
+                     const std::string &prefix, const std::string &format,
+                     size_t chunk_bytes, ArgParser *args);
+
+// what the export key (& -batch) does: streams args->stream_input
+// through the cuts of tree if given, otherwise exports its leaves
+int WritePartitions(BSPTree *tree, ArgParser *args);
+
+#endif
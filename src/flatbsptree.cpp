@@ -0,0 +1,280 @@
+#include <cstring>
+#include <algorithm>
+
+#include "flatbsptree.h"
+#include "bsptree.h"
+#include "argparser.h"
+
+// ======================================================================
+// MESH POOL
+// ======================================================================
+
+MeshPool::~MeshPool() {
+  for (unsigned int i = 0; i < meshes.size(); i++) {
+    delete meshes[i];
+  }
+}
+
+unsigned int MeshPool::Add(Mesh *mesh) {
+  assert (mesh != NULL);
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!free_handles.empty()) {
+    unsigned int handle = free_handles.back();
+    free_handles.pop_back();
+    meshes[handle] = mesh;
+    return handle;
+  }
+  meshes.push_back(mesh);
+  return meshes.size()-1;
+}
+
+Mesh* MeshPool::Release(unsigned int handle) {
+  std::lock_guard<std::mutex> lock(mutex);
+  assert (handle < meshes.size() && meshes[handle] != NULL);
+  Mesh *mesh = meshes[handle];
+  meshes[handle] = NULL;
+  free_handles.push_back(handle);
+  return mesh;
+}
+
+void MeshPool::Collect(const std::vector<std::unique_ptr<FlatBSPTree> > &trees) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<char> used(meshes.size(), 0);
+  for (unsigned int i = 0; i < trees.size(); i++) {
+    if (trees[i] == NULL) continue;
+    for (unsigned int j = 0; j < trees[i]->numNodes(); j++) {
+      const FlatBSPNode &node = trees[i]->getNode(j);
+      if (node.left == FLAT_BSP_NONE) {
+        assert (node.mesh < meshes.size());
+        used[node.mesh] = 1;
+      }
+    }
+  }
+  for (unsigned int i = 0; i < meshes.size(); i++) {
+    if (meshes[i] != NULL && !used[i]) {
+      delete meshes[i];
+      meshes[i] = NULL;
+      free_handles.push_back(i);
+    }
+  }
+}
+
+// ======================================================================
+// CONSTRUCTORS
+// ======================================================================
+
+FlatBSPTree::FlatBSPTree(ArgParser *_args, MeshPool *_pool, unsigned int mesh) {
+  args = _args;
+  pool = _pool;
+  FlatBSPNode root = FlatBSPNode();
+  setSummary(root, pool->Get(mesh));
+  root.left = root.right = FLAT_BSP_NONE;
+  root.mesh = mesh;
+  nodes.push_back(root);
+}
+
+FlatBSPTree::FlatBSPTree(const FlatBSPTree &tree) {
+  args = tree.args;
+  pool = tree.pool;
+  // (a copy is nearly always cut next)
+  nodes.reserve(tree.nodes.size() + 2);
+  nodes.resize(tree.nodes.size());
+  memcpy(nodes.data(), tree.nodes.data(), nodes.size() * sizeof(FlatBSPNode));
+}
+
+FlatBSPTree& FlatBSPTree::operator= (const FlatBSPTree &tree) {
+  if (this == &tree) return *this;
+  args = tree.args;
+  pool = tree.pool;
+  nodes.resize(tree.nodes.size());
+  memcpy(nodes.data(), tree.nodes.data(), nodes.size() * sizeof(FlatBSPNode));
+  return *this;
+}
+
+// fills in the bounding box summary of node from mesh
+void FlatBSPTree::setSummary(FlatBSPNode &node, const Mesh &mesh) const {
+  node.bbox_min = mesh.getBoundingBox().getMin();
+  node.bbox_max = mesh.getBoundingBox().getMax();
+  node.bbox_volume = mesh.getBBVolume();
+  node.print_volumes = mesh.numPrintVolumes(args->printing_width, args->printing_height, args->printing_length);
+  node.fits = mesh.fitsInVolume(args->printing_width, args->printing_height, args->printing_length);
+}
+
+// ======================================================================
+// CONVERSION
+// ======================================================================
+
+FlatBSPTree* FlatBSPTree::FromTree(BSPTree *tree, ArgParser *args, MeshPool *pool) {
+  FlatBSPTree *flat = new FlatBSPTree();
+  flat->args = args;
+  flat->pool = pool;
+
+  // (source node, index of its flat node) pairs still to be visited
+  std::vector<std::pair<BSPTree*,unsigned int> > todo;
+  FlatBSPNode root = FlatBSPNode();
+  flat->nodes.push_back(root);
+  todo.push_back(std::make_pair(tree, 0u));
+  while (!todo.empty()) {
+    BSPTree *t = todo.back().first;
+    unsigned int i = todo.back().second;
+    todo.pop_back();
+
+    FlatBSPNode node = FlatBSPNode();
+    // (interior nodes have cleared meshes, which keep their bounding box)
+    flat->setSummary(node, t->getMesh());
+    node.normal = t->getNormal();
+    node.offset = t->getOffset();
+    node.grade = t->getGrade();
+    node.depth = t->getDepth();
+    node.left = node.right = node.mesh = FLAT_BSP_NONE;
+    if (t->isLeaf()) {
+      node.mesh = pool->Add(new Mesh(t->takeMesh()));
+    } else {
+      node.left = flat->nodes.size();
+      node.right = node.left + 1;
+      flat->nodes.push_back(root);
+      flat->nodes.push_back(root);
+      todo.push_back(std::make_pair(t->rightChild, node.right));
+      todo.push_back(std::make_pair(t->leftChild, node.left));
+    }
+    flat->nodes[i] = node;
+  }
+  delete tree;
+  return flat;
+}
+
+BSPTree* FlatBSPTree::ToTree(bool copy_meshes) const {
+  std::vector<BSPTree*> built(nodes.size());
+  for (unsigned int i = 0; i < nodes.size(); i++) {
+    const FlatBSPNode &node = nodes[i];
+    built[i] = new BSPTree(args, node.depth);
+    built[i]->setNormal(node.normal);
+    built[i]->setOffset(node.offset);
+    built[i]->setGrade(node.grade);
+    if (isLeaf(i) && copy_meshes) {
+      built[i]->setMesh(Mesh(pool->Get(node.mesh)));
+    } else if (isLeaf(i)) {
+      Mesh *mesh = pool->Release(node.mesh);
+      built[i]->setMesh(std::move(*mesh));
+      delete mesh;
+    } else {
+      built[i]->setBoundingBox(node.bbox_min, node.bbox_max);
+    }
+  }
+  for (unsigned int i = 0; i < nodes.size(); i++) {
+    if (!isLeaf(i)) {
+      built[i]->leftChild = built[nodes[i].left];
+      built[i]->rightChild = built[nodes[i].right];
+    }
+  }
+  return built[0];
+}
+
+// ======================================================================
+// CUTTING
+// ======================================================================
+
+void FlatBSPTree::cut(unsigned int leaf, const glm::vec3 &normal, float offset,
+                      unsigned int left_mesh, unsigned int right_mesh) {
+  assert (isLeaf(leaf));
+  FlatBSPNode left = FlatBSPNode();
+  FlatBSPNode right = FlatBSPNode();
+  setSummary(left, pool->Get(left_mesh));
+  setSummary(right, pool->Get(right_mesh));
+  left.depth = right.depth = nodes[leaf].depth + 1;
+  left.left = left.right = right.left = right.right = FLAT_BSP_NONE;
+  left.mesh = left_mesh;
+  right.mesh = right_mesh;
+
+  nodes[leaf].normal = normal;
+  nodes[leaf].offset = offset;
+  nodes[leaf].left = nodes.size();
+  nodes[leaf].right = nodes.size() + 1;
+  nodes[leaf].mesh = FLAT_BSP_NONE;
+  nodes.push_back(left);
+  nodes.push_back(right);
+}
+
+// ======================================================================
+// VOLUME & OBJECTIVE FUNCTIONS
+// ======================================================================
+
+bool FlatBSPTree::fitsInVolume() const {
+  for (unsigned int i = 0; i < nodes.size(); i++) {
+    if (nodes[i].left == FLAT_BSP_NONE && !nodes[i].fits) return false;
+  }
+  return true;
+}
+
+unsigned int FlatBSPTree::largestPart() const {
+  // visit the leaves left to right like BSPTree::largestPart, so ties
+  // go to the rightmost of them
+  unsigned int largest = FLAT_BSP_NONE;
+  std::vector<unsigned int> stack(1, 0);
+  while (!stack.empty()) {
+    unsigned int i = stack.back();
+    stack.pop_back();
+    if (nodes[i].left != FLAT_BSP_NONE) {
+      stack.push_back(nodes[i].right);
+      stack.push_back(nodes[i].left);
+      continue;
+    }
+    if (largest == FLAT_BSP_NONE || nodes[i].print_volumes >= nodes[largest].print_volumes) {
+      largest = i;
+    }
+  }
+  assert (largest != FLAT_BSP_NONE);
+  return largest;
+}
+
+glm::vec3 FlatBSPTree::getBoundingBoxDims() const {
+  const FlatBSPNode &node = nodes[largestPart()];
+  return node.bbox_max - node.bbox_min;
+}
+
+float FlatBSPTree::fPart() const {
+  // printing volumes of all the partitions relative to the initial mesh
+  int totalPrintVolumes = 0;
+  for (unsigned int i = 0; i < nodes.size(); i++) {
+    if (nodes[i].left == FLAT_BSP_NONE) totalPrintVolumes += nodes[i].print_volumes;
+  }
+  return (1.0f / nodes[0].print_volumes) * totalPrintVolumes;
+}
+
+float FlatBSPTree::fUtil() const {
+  // max of ( 1 - partBBoxVolume/(numPrintVolumes * printingVolume) ) over the partitions
+  float printingVolume = args->printing_width * args->printing_height * args->printing_length;
+  float util = 0;
+  bool first = true;
+  for (unsigned int i = 0; i < nodes.size(); i++) {
+    if (nodes[i].left != FLAT_BSP_NONE) continue;
+    float u = 1 - nodes[i].bbox_volume / (nodes[i].print_volumes * printingVolume);
+    if (first || u > util) util = u;
+    first = false;
+  }
+  return util;
+}
+
+float FlatBSPTree::gradeCut(unsigned int leaf, const Mesh &left, const Mesh &right) const {
+  assert (isLeaf(leaf));
+  FlatBSPNode halves[2] = { FlatBSPNode(), FlatBSPNode() };
+  setSummary(halves[0], left);
+  setSummary(halves[1], right);
+  halves[0].left = halves[1].left = FLAT_BSP_NONE;
+
+  // fPart & fUtil over the other leaves & the two halves
+  float printingVolume = args->printing_width * args->printing_height * args->printing_length;
+  int totalPrintVolumes = 0;
+  float util = 0;
+  bool first = true;
+  for (unsigned int i = 0; i < nodes.size() + 2; i++) {
+    const FlatBSPNode &node = (i < nodes.size()) ? nodes[i] : halves[i - nodes.size()];
+    if (i == leaf || node.left != FLAT_BSP_NONE) continue;
+    totalPrintVolumes += node.print_volumes;
+    float u = 1 - node.bbox_volume / (node.print_volumes * printingVolume);
+    if (first || u > util) util = u;
+    first = false;
+  }
+  float part = (1.0f / nodes[0].print_volumes) * totalPrintVolumes;
+  return args->a_part*part + args->a_util*util;
+}
@@ -0,0 +1,168 @@
+#ifndef _FLAT_BSP_TREE_H_
+#define _FLAT_BSP_TREE_H_
+
+#include <cassert>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <glm/glm.hpp>
+
+class ArgParser;
+class Mesh;
+class BSPTree;
+class FlatBSPTree;
+
+// ======================================================================
+// The tree representation used by the beam search.  The nodes of a
+// FlatBSPTree live in one array, linked by 32-bit indices, and every
+// node carries the bounding box summary the objective functions need,
+// so grading a tree or finding its largest part is a loop over that
+// array and never touches a mesh.  Meshes aren't part of the tree: a
+// leaf holds a handle into a MeshPool shared by all the trees of one
+// search (a cut only adds its two new meshes), which makes copying a
+// candidate a single memcpy of the node array.
+//
+// Node 0 is the root and the two children of a cut are appended to the
+// end, so unlike CutPlan the array is not in depth first order.
+// ======================================================================
+
+#define FLAT_BSP_NONE 0xffffffffu
+
+// plain data, trees copy their nodes with memcpy
+struct FlatBSPNode {
+  // cutting plane (interior nodes), same convention as BSPTree::chop
+  glm::vec3 normal;
+  float offset;
+  // bounding box of the part below this node
+  glm::vec3 bbox_min;
+  glm::vec3 bbox_max;
+  float bbox_volume;
+  // printing volumes needed for that box & whether it fits in one
+  int print_volumes;
+  int fits;
+  // objective function grade of the tree when this node was cut
+  float grade;
+  unsigned int depth;
+  // children, FLAT_BSP_NONE for a leaf
+  unsigned int left;
+  unsigned int right;
+  // MeshPool handle of a leaf's mesh (FLAT_BSP_NONE for interior nodes)
+  unsigned int mesh;
+};
+
+// ======================================================================
+// Owns the meshes of the leaves of a set of FlatBSPTrees.  Several trees
+// may share a mesh, Collect() frees the ones no tree uses any more.
+// Add, Get & Release may be called from several threads at once.
+
+class MeshPool {
+
+public:
+
+  MeshPool() {}
+  ~MeshPool();
+
+  // takes ownership of mesh
+  unsigned int Add(Mesh *mesh);
+  const Mesh& Get(unsigned int handle) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    assert (handle < meshes.size() && meshes[handle] != NULL);
+    return *meshes[handle]; }
+  // gives the mesh up to the caller, the handle becomes invalid
+  Mesh* Release(unsigned int handle);
+  // frees every mesh that isn't held by a leaf of one of trees
+  // (NULL entries are skipped)
+  void Collect(const std::vector<std::unique_ptr<FlatBSPTree> > &trees);
+
+  int numMeshes() const { return meshes.size() - free_handles.size(); }
+
+private:
+
+  MeshPool(const MeshPool&) = delete;
+  MeshPool& operator=(const MeshPool&) = delete;
+
+  // ==============
+  // REPRESENTATION
+  std::vector<Mesh*> meshes;  // NULL = free
+  std::vector<unsigned int> free_handles;
+  // (the meshes themselves never move, only the handle arrays do)
+  mutable std::mutex mutex;
+};
+
+// ======================================================================
+
+class FlatBSPTree {
+
+public:
+
+  // ========================
+  // CONSTRUCTORS
+  // a single leaf holding mesh (a handle in pool)
+  FlatBSPTree(ArgParser *args, MeshPool *pool, unsigned int mesh);
+  // (leaves room for the two nodes of the next cut)
+  FlatBSPTree(const FlatBSPTree &tree);
+  FlatBSPTree& operator= (const FlatBSPTree &tree);
+
+  // conversion from & to the pointer based tree: FromTree moves the
+  // meshes of the leaves of tree into pool and deletes tree, ToTree
+  // builds a new BSPTree & takes the meshes of the leaves out of the
+  // pool (so no other tree may use them afterwards), or copies them
+  // with copy_meshes
+  static FlatBSPTree* FromTree(BSPTree *tree, ArgParser *args, MeshPool *pool);
+  BSPTree* ToTree(bool copy_meshes = false) const;
+
+  // =========
+  // ACCESSORS
+  unsigned int numNodes() const { return nodes.size(); }
+  const FlatBSPNode& getNode(unsigned int i) const {
+    assert (i < nodes.size()); return nodes[i]; }
+  bool isLeaf(unsigned int i) const { return getNode(i).left == FLAT_BSP_NONE; }
+  // the grade of the whole tree (kept at the root)
+  float getGrade() const { return nodes[0].grade; }
+  const Mesh& getMesh(unsigned int leaf) const {
+    assert (isLeaf(leaf)); return pool->Get(nodes[leaf].mesh); }
+  MeshPool* getPool() const { return pool; }
+
+  // =========
+  // MODIFIERS
+  void setGrade(float g) { nodes[0].grade = g; }
+  void setNodeGrade(unsigned int i, float g) { assert (i < nodes.size()); nodes[i].grade = g; }
+  // turns leaf into an interior node with two new leaves holding the
+  // left & right pool meshes (the halves from BSPTree::SplitMesh)
+  void cut(unsigned int leaf, const glm::vec3 &normal, float offset,
+           unsigned int left_mesh, unsigned int right_mesh);
+
+  // ===============
+  // the BSPTree volume & objective functions, over the node array
+  bool fitsInVolume() const;
+  // the leaf needing the most printing volumes (ties go to the
+  // rightmost one, as in BSPTree::largestPart)
+  unsigned int largestPart() const;
+  glm::vec3 getBoundingBoxDims() const;
+  float fPart() const;
+  float fUtil() const;
+  // the objective function grade this tree would have with leaf cut
+  // into left & right (the same as cutting a copy & grading it)
+  float gradeCut(unsigned int leaf, const Mesh &left, const Mesh &right) const;
+
+private:
+
+  FlatBSPTree() { args = NULL; pool = NULL; }
+  void setSummary(FlatBSPNode &node, const Mesh &mesh) const;
+
+  // ==============
+  // REPRESENTATION
+  ArgParser *args;
+  MeshPool *pool;
+  std::vector<FlatBSPNode> nodes;
+};
+
+// class to order FlatBSPTrees by their objective function grade, best first
+class FlatBSPTreeLessThan {
+public:
+  bool operator() (const std::unique_ptr<FlatBSPTree> &lhs, const std::unique_ptr<FlatBSPTree> &rhs) const {
+    return lhs->getGrade() < rhs->getGrade();
+  }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include <cstdio>
+#include <GLFW/glfw3.h>
+
+#include "frametimer.h"
+#include "utils.h"
+
+// seconds between reports
+#define FRAME_TIMER_REPORT_INTERVAL 0.5
+
+// ======================================================================
+
+FrameTimer::FrameTimer() {
+  for (int i = 0; i < FRAME_TIMER_QUERIES; i++) queries[i] = 0;
+  next_query = 0;
+  num_pending = 0;
+  query_started = false;
+  frame_start = 0;
+  report_time = 0;
+  cpu_frames = gpu_frames = 0;
+  cpu_seconds = gpu_seconds = 0;
+}
+
+void FrameTimer::initialize() {
+  glGenQueries(FRAME_TIMER_QUERIES, queries);
+  report_time = glfwGetTime();
+  HandleGLError("leaving FrameTimer::initialize()");
+}
+
+void FrameTimer::cleanup() {
+  // (0 = never initialized)
+  if (queries[0] == 0) return;
+  glDeleteQueries(FRAME_TIMER_QUERIES, queries);
+  for (int i = 0; i < FRAME_TIMER_QUERIES; i++) queries[i] = 0;
+  num_pending = 0;
+}
+
+void FrameTimer::beginFrame() {
+  collectQueries();
+  // (with every query still in flight this frame's GPU time is skipped)
+  query_started = (num_pending < FRAME_TIMER_QUERIES);
+  if (query_started) {
+    glBeginQuery(GL_TIME_ELAPSED, queries[next_query]);
+  }
+  frame_start = glfwGetTime();
+}
+
+void FrameTimer::endFrame() {
+  // (the CPU time ends before glEndQuery, which may wait on the driver)
+  cpu_seconds += glfwGetTime() - frame_start;
+  cpu_frames++;
+  if (query_started) {
+    glEndQuery(GL_TIME_ELAPSED);
+    next_query = (next_query + 1) % FRAME_TIMER_QUERIES;
+    num_pending++;
+    query_started = false;
+  }
+}
+
+void FrameTimer::collectQueries() {
+  while (num_pending > 0) {
+    GLuint q = queries[(next_query + FRAME_TIMER_QUERIES - num_pending) % FRAME_TIMER_QUERIES];
+    GLint available = 0;
+    glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) break;
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(q, GL_QUERY_RESULT, &nanoseconds);
+    gpu_seconds += nanoseconds * 1e-9;
+    gpu_frames++;
+    num_pending--;
+  }
+}
+
+bool FrameTimer::Update() {
+  collectQueries();
+  double now = glfwGetTime();
+  if (cpu_frames == 0 || now - report_time < FRAME_TIMER_REPORT_INTERVAL) return false;
+  char buf[128];
+  if (gpu_frames > 0) {
+    snprintf(buf, sizeof(buf), "%.1f fps, cpu %.2f ms, gpu %.2f ms",
+             cpu_frames / (now - report_time),
+             1000 * cpu_seconds / cpu_frames, 1000 * gpu_seconds / gpu_frames);
+  } else {
+    snprintf(buf, sizeof(buf), "%.1f fps, cpu %.2f ms",
+             cpu_frames / (now - report_time), 1000 * cpu_seconds / cpu_frames);
+  }
+  report = buf;
+  report_time = now;
+  cpu_frames = gpu_frames = 0;
+  cpu_seconds = gpu_seconds = 0;
+  return true;
+}
@@ -0,0 +1,60 @@
+#ifndef _FRAME_TIMER_H_
+#define _FRAME_TIMER_H_
+
+#include <string>
+#include <GL/glew.h>
+
+// ======================================================================
+// Measures what drawing a frame costs (-frame_timing): the CPU time
+// spent issuing the GL calls, and the GPU time of the same calls from a
+// GL_TIME_ELAPSED query.  The query results are read a few frames late,
+// when they're ready, so measuring never stalls the pipeline.  Every
+// half second or so the averages are turned into a short report.
+// ======================================================================
+
+// (how many frames of queries may be in flight)
+#define FRAME_TIMER_QUERIES 4
+
+class FrameTimer {
+
+public:
+
+  FrameTimer();
+
+  void initialize();
+  void cleanup();
+
+  // around the GL calls of one frame (not the buffer swap)
+  void beginFrame();
+  void endFrame();
+
+  // true when a new report is ready (then getReport() has it)
+  bool Update();
+  const std::string& getReport() const { return report; }
+
+private:
+
+  FrameTimer(const FrameTimer&) = delete;
+  FrameTimer& operator=(const FrameTimer&) = delete;
+
+  // reads the queries that are done, oldest first
+  void collectQueries();
+
+  // ==============
+  // REPRESENTATION
+  GLuint queries[FRAME_TIMER_QUERIES];
+  // the queries in flight are the num_pending before next_query
+  unsigned int next_query;
+  unsigned int num_pending;
+  bool query_started;
+  double frame_start;
+  // since the last report
+  double report_time;
+  unsigned int cpu_frames;
+  double cpu_seconds;
+  unsigned int gpu_frames;
+  double gpu_seconds;
+  std::string report;
+};
+
+#endif
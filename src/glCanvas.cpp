@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <algorithm>
 #include "glCanvas.h"
 #include "argparser.h"
 #include "camera.h"
@@ -10,8 +11,33 @@
 #endif
 
 #include "bsptree.h"
+#include "flatbsptree.h"
 // #include "mesh.h"
 #include "utils.h"
+#include "exporter.h"
+#include "cutplan.h"
+#include "resultcache.h"
+#include "threadpool.h"
+#include "cutcollector.h"
+#include "searchcontrol.h"
+#include "frametimer.h"
+#include "cutpreview.h"
+#include "thumbnail.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// offsets one beam search task cuts at (a batch is the unit of work
+// the scheduler moves between threads)
+#ifndef BEAM_CUTS_PER_TASK
+#define BEAM_CUTS_PER_TASK 4
+#endif
+// how many more of its best cuts than the beam width every (tree, normal)
+// pair keeps for the diversity filter, as a multiple of the beam width
+#ifndef BEAM_CUT_RESERVE
+#define BEAM_CUT_RESERVE 1
+#endif
 
 // ========================================================
 // static variables of GLCanvas class
@@ -37,6 +63,19 @@ bool GLCanvas::altKeyPressed = false;
 bool GLCanvas::superKeyPressed = false;
 
 GLuint GLCanvas::render_VAO;
+PartitionBuffers GLCanvas::partitions;
+
+SearchControl* GLCanvas::search = NULL;
+std::thread GLCanvas::search_thread;
+// (the progress shown in the title)
+static std::string search_status;
+
+bool GLCanvas::redraw = true;
+FrameTimer* GLCanvas::frame_timer = NULL;
+
+CutPreview* GLCanvas::preview = NULL;
+int GLCanvas::preview_part = -1;
+bool GLCanvas::preview_clip = false;
 
 GLuint GLCanvas::ViewMatrixID;
 GLuint GLCanvas::ModelMatrixID;
@@ -45,6 +84,14 @@ GLuint GLCanvas::MatrixID;
 GLuint GLCanvas::programID;
 GLuint GLCanvas::colormodeID;
 GLuint GLCanvas::wireframeID;
+GLuint GLCanvas::gouraudID;
+GLuint GLCanvas::previewPlaneID;
+GLuint GLCanvas::previewPartID;
+GLuint GLCanvas::previewClipID;
+GLuint GLCanvas::drawingCapID;
+GLuint GLCanvas::capOriginID;
+GLuint GLCanvas::capAxisUID;
+GLuint GLCanvas::capAxisVID;
 
 
 // ========================================================
@@ -73,6 +120,8 @@ void GLCanvas::initialize(ArgParser *_args) {
     exit(1);
   }
 
+  // (the clipped cut preview draws its cap with the stencil buffer)
+  glfwWindowHint(GLFW_STENCIL_BITS, 8);
   // We will ask it to specifically open an OpenGL 3.2 context
   glfwWindowHint(GLFW_SAMPLES, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -110,9 +159,11 @@ void GLCanvas::initialize(ArgParser *_args) {
   glfwSetCursorPosCallback(GLCanvas::window,GLCanvas::mousemotionCB);
   glfwSetMouseButtonCallback(GLCanvas::window,GLCanvas::mousebuttonCB);
   glfwSetKeyCallback(GLCanvas::window,GLCanvas::keyboardCB);
+  glfwSetWindowRefreshCallback(GLCanvas::window,GLCanvas::windowrefreshCB);
 
   programID = LoadShaders( args->path+"/"+args->shader_filename+".vs",
-                           args->path+"/"+args->shader_filename+".fs");
+                           args->path+"/"+args->shader_filename+".fs",
+                           args->path+"/"+args->shader_filename+".gs");
 
 printf("here 1\n");
   GLCanvas::initializeVBOs();
@@ -144,11 +195,21 @@ void GLCanvas::initializeVBOs(){
   GLCanvas::ModelMatrixID = glGetUniformLocation(GLCanvas::programID, "M");
   GLCanvas::colormodeID = glGetUniformLocation(GLCanvas::programID, "colormode");
   GLCanvas::wireframeID = glGetUniformLocation(GLCanvas::programID, "wireframe");
+  GLCanvas::gouraudID = glGetUniformLocation(GLCanvas::programID, "gouraud");
+  GLCanvas::previewPlaneID = glGetUniformLocation(GLCanvas::programID, "previewPlane");
+  GLCanvas::previewPartID = glGetUniformLocation(GLCanvas::programID, "previewPart");
+  GLCanvas::previewClipID = glGetUniformLocation(GLCanvas::programID, "previewClip");
+  GLCanvas::drawingCapID = glGetUniformLocation(GLCanvas::programID, "drawingCap");
+  GLCanvas::capOriginID = glGetUniformLocation(GLCanvas::programID, "capOrigin");
+  GLCanvas::capAxisUID = glGetUniformLocation(GLCanvas::programID, "capAxisU");
+  GLCanvas::capAxisVID = glGetUniformLocation(GLCanvas::programID, "capAxisV");
 
   // mesh->initializeVBOs();
-  printf("test 1\n");
-  tree->initializeVBOs();
-  printf("test 2\n");
+  partitions.initializeVBOs(GLCanvas::programID);
+  if (args->frame_timing) {
+    frame_timer = new FrameTimer();
+    frame_timer->initialize();
+  }
   HandleGLError("leaving initilizeVBOs()");
 }
 
@@ -158,7 +219,7 @@ void GLCanvas::setupVBOs(){
   // assert (mesh != NULL);
   // mesh->setupVBOs();
   assert (tree != NULL);
-  tree->setupVBOs();
+  partitions.setupVBOs(tree, args);
   HandleGLError("leaving GLCanvas::setupVBOs()");
 }
 
@@ -177,8 +238,27 @@ void GLCanvas::drawVBOs(const glm::mat4 &ProjectionMatrix,const glm::mat4 &ViewM
   glUniformMatrix4fv(GLCanvas::ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
   glUniformMatrix4fv(GLCanvas::ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
 
+  // mode 1: STANDARD PHONG LIGHTING (LIGHT ON)
+  glUniform1i(GLCanvas::colormodeID, 1);
+  glUniform1i(GLCanvas::wireframeID, args->wireframe);
+  glUniform1i(GLCanvas::gouraudID, args->gouraud_normals);
+
+  // the plane of the cut preview (in model space)
+  if (preview != NULL) {
+    const glm::vec3 &n = preview->getNormal();
+    glUniform4f(GLCanvas::previewPlaneID, n.x, n.y, n.z, preview->getOffset());
+  }
+  glUniform1i(GLCanvas::previewPartID, (preview != NULL) ? preview_part : -1);
+  glUniform1i(GLCanvas::previewClipID, preview_clip);
+  glUniform1i(GLCanvas::drawingCapID, 0);
+
   // mesh->drawVBOs();
-  tree->drawVBOs();
+  int width, height;
+  glfwGetWindowSize(window, &width, &height);
+  partitions.drawVBOs(MVP, width, height, args->full_detail, args->wireframe);
+  if (preview != NULL && preview_clip) {
+    drawPreviewCap();
+  }
   HandleGLError("leaving GlCanvas::drawVBOs()");
 }
 
@@ -186,7 +266,12 @@ void GLCanvas::drawVBOs(const glm::mat4 &ProjectionMatrix,const glm::mat4 &ViewM
 void GLCanvas::cleanupVBOs(){
   bbox.cleanupVBOs();
   // mesh->cleanupVBOs();
-  tree->cleanupVBOs();
+  partitions.cleanupVBOs();
+  if (frame_timer != NULL) {
+    frame_timer->cleanup();
+    delete frame_timer;
+    frame_timer = NULL;
+  }
 }
 
 
@@ -227,7 +312,13 @@ void GLCanvas::mousebuttonCB(GLFWwindow *window, int which_button, int action, i
 void GLCanvas::mousemotionCB(GLFWwindow *window, double x, double y) {
 
   // camera controls that work well for a 3 button mouse
-  if (!shiftKeyPressed && !controlKeyPressed && !altKeyPressed) {
+  if (preview != NULL && leftMousePressed && !shiftKeyPressed && !controlKeyPressed && !altKeyPressed) {
+    // (dragging over the whole window moves the plane through the part)
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    float extent = preview->getMaxOffset() - preview->getMinOffset();
+    movePreview((mouseY-y) / float(height) * extent);
+  } else if (!shiftKeyPressed && !controlKeyPressed && !altKeyPressed) {
     if (leftMousePressed) {
       camera->rotateCamera(mouseX-x,mouseY-y);
     } else if (middleMousePressed)  {
@@ -248,6 +339,8 @@ void GLCanvas::mousemotionCB(GLFWwindow *window, double x, double y) {
     if (altKeyPressed) {
       camera->dollyCamera(y-mouseY);
     }
+    // (the camera moved)
+    redraw = true;
   }
   mouseX = x;
   mouseY = y;
@@ -269,7 +362,14 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
     glfwSetWindowShouldClose(GLCanvas::window, GL_TRUE);
   }
 
-  int tempWire;
+  // the cut preview's special keys
+  if (preview != NULL && (action == GLFW_PRESS || action == GLFW_REPEAT)) {
+    float step = 0.01f * (preview->getMaxOffset() - preview->getMinOffset());
+    if (key == GLFW_KEY_UP) movePreview(step);
+    if (key == GLFW_KEY_DOWN) movePreview(-step);
+    if (key == GLFW_KEY_ENTER || key == GLFW_KEY_KP_ENTER) commitPreview();
+    redraw = true;
+  }
 
   // other normal ascii keys...
   if ( (action == GLFW_PRESS || action == GLFW_REPEAT) && key < 256) {
@@ -277,50 +377,77 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
     case 'b': case 'B':
       args->bounding_box = !args->bounding_box;
       // mesh->setupVBOs();
-      tree->setupVBOs();
       break;
     case 'g': case 'G':
       args->geometry = !args->geometry;
       // mesh->setupVBOs();
-      tree->setupVBOs();
       break;
     case 'n': case 'N':
       printf("ADDING GOURAUD SHADING\n");
       args->gouraud_normals = !args->gouraud_normals;
       // mesh->setupVBOs();
-      tree->setupVBOs();
       break;
     case 'w': case 'W':
       printf("CREATING WIREFRAME\n");
       args->wireframe = !args->wireframe;
       // mesh->setupVBOs();
-      tree->setupVBOs();
       break;
     case 'c': case 'C':
       //cut the mesh into partitions for printing
       printf("CUTTING THE MESH INTO PARTITIONS FOR PRINTING\n");
-      tempWire = args->wireframe;
-      args->wireframe = 0;
-      tree->setupVBOs();
-      // tree->chop(glm::vec3(1.0f, 0.0f, 0.0f), 0.0);
-      // tree->initializeVBOs();
-      // tree->setupVBOs();
-      // tree->leftChild->chop(glm::vec3(0.0f, 1.0f, 0.0f), 0.1511);
-      tree = beamSearch(tree);
-      tree->initializeVBOs();
-      tree->setupVBOs();
-      args->wireframe = tempWire;
-      tree->setupVBOs();
+      startSearch();
+      break;
+    case 'p': case 'P':
+      // pause / resume the search
+      if (search != NULL) {
+        search->setPaused(!search->isPaused());
+        printf(search->isPaused() ? "SEARCH PAUSED\n" : "SEARCH RESUMED\n");
+      }
+      break;
+    case 'x': case 'X':
+      // stop the search, keeping its best tree so far
+      if (search != NULL) {
+        printf("CANCELLING THE SEARCH\n");
+        search->Cancel();
+      }
+      break;
+    case 'v': case 'V':
+      // preview cutting the largest part (or stop previewing)
+      if (preview == NULL) {
+        startPreview();
+      } else {
+        stopPreview();
+      }
+      break;
+    case 'k': case 'K':
+      // cut the previewed part open along the plane (or close it again)
+      preview_clip = !preview_clip;
+      break;
+    case '[':
+      turnPreview(-1);
+      break;
+    case ']':
+      turnPreview(1);
       break;
     case 'o': case 'O':
-      //output scene into obj file
-      // printf("WRITING SCENE TO FILE\n");
-      // mesh->OutputFile();
+      // write every partition into its own obj/stl file
+      printf("WRITING PARTITIONS TO FILES\n");
+      WritePartitions(tree, args);
       break;
+    case 't': case 'T': {
+      // draw the current view on the CPU, like -thumbnail does, & save
+      // the camera for -thumbnail_camera
+      std::string prefix = OutputPrefix(args);
+      int width, height;
+      glfwGetWindowSize(window, &width, &height);
+      RenderThumbnail(tree, camera, width, height, prefix + "_thumbnail.png");
+      std::ofstream ostr((prefix + "_thumbnail.camera").c_str());
+      ostr << *camera;
+      break;
+    }
     case 'l' : case 'L':
       //LoadCompileLinkShaders();
       // mesh->setupVBOs();
-      tree->setupVBOs();
       break;
     case 'q':  case 'Q':
       // quit
@@ -330,21 +457,235 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
       std::cout << "UNKNOWN KEYBOARD INPUT  '" << (char)key << "'" << std::endl;
     }
     setupVBOs();
+    redraw = true;
   }
 }
 
+// ========================================================
+// Callback function for the window needing to be drawn
+// (uncovered, resized, ...)
+// ========================================================
+
+void GLCanvas::windowrefreshCB(GLFWwindow *window) {
+  redraw = true;
+}
+
 
 // ========================================================
-// Load the vertex & fragment shaders
+// Background search
 // ========================================================
 
-GLuint LoadShaders(const std::string &vertex_file_path,const std::string &fragment_file_path){
+void GLCanvas::startSearch() {
+  if (search != NULL) {
+    printf("the search is already running\n");
+    return;
+  }
+  // the search takes the tree as it is & the window draws a copy of it
+  // meanwhile (so the search works on exactly what a -batch run loads)
+  // (the preview's leaf would go away with the tree)
+  stopPreview();
+  BSPTree *work = tree;
+  tree = new BSPTree(*work);
+
+  search = new SearchControl();
+  SearchControl *control = search;
+  search_thread = std::thread([work, control]() {
+    // (the same colours as a -batch run with the same seed)
+    args->seedRandom({0});
+    control->Finish(partition(work, control));
+  });
+}
+
+void GLCanvas::updateSearch() {
+  if (search == NULL) return;
+  // (checked first: once done is set the result has been published)
+  bool done = search->isDone();
+
+  BSPTree *snapshot = search->TakeSnapshot();
+  if (snapshot != NULL) {
+    delete tree;
+    tree = snapshot;
+    setupVBOs();
+    redraw = true;
+  }
+
+  // progress in the window title, about twice a second
+  static double last_time = 0;
+  static unsigned long long last_candidates = 0;
+  double now = glfwGetTime();
+  if (done) {
+    search_thread.join();
+    delete search;
+    search = NULL;
+    last_time = 0;
+    last_candidates = 0;
+    search_status = "";
+    updateTitle();
+  } else if (now - last_time >= 0.5) {
+    unsigned long long candidates = search->numCandidates();
+    double rate = (last_time > 0) ? (candidates - last_candidates) / (now - last_time) : 0;
+    char status[256];
+    snprintf(status, sizeof(status), "searching: iteration %d, %.0f cuts/s%s",
+             search->getIteration(), rate, search->isPaused() ? " (paused)" : "");
+    search_status = status;
+    updateTitle();
+    last_time = now;
+    last_candidates = candidates;
+  }
+}
+
+void GLCanvas::stopSearch() {
+  if (search == NULL) return;
+  search->Cancel();
+  search_thread.join();
+  delete search;
+  search = NULL;
+}
+
+void GLCanvas::updateTitle() {
+  std::string title = "OpenGL viewer";
+  if (search_status != "") title += " - " + search_status;
+  if (preview != NULL) {
+    char status[256];
+    if (preview->cutsLeaf()) {
+      snprintf(status, sizeof(status), "cut preview: normal %u, offset %.4f, fPart %.3f, fUtil %.3f, grade %.3f",
+               preview->getNormalIndex(), preview->getOffset(),
+               preview->fPart(), preview->fUtil(), preview->getGrade());
+    } else {
+      snprintf(status, sizeof(status), "cut preview: normal %u, offset %.4f misses the part",
+               preview->getNormalIndex(), preview->getOffset());
+    }
+    title += std::string(" - ") + status;
+  }
+  if (frame_timer != NULL && frame_timer->getReport() != "") {
+    char drawn[128];
+    snprintf(drawn, sizeof(drawn), " (%u/%u parts, %u triangles)",
+             partitions.numDrawnParts(), partitions.numParts(), partitions.numDrawnTriangles());
+    title += " - " + frame_timer->getReport() + drawn;
+  }
+  glfwSetWindowTitle(window, title.c_str());
+}
+
+// ========================================================
+// Interactive cut preview
+// ========================================================
+
+void GLCanvas::startPreview() {
+  if (search != NULL) {
+    printf("can't preview cuts while the search is running\n");
+    return;
+  }
+  // the largest part, like the search cuts
+  BSPTree *leaf = NULL;
+  tree->largestPart(args->printing_width, args->printing_height, args->printing_length, leaf);
+  assert (leaf != NULL);
+  if (leaf->getMesh().numVertices() == 0) return;
+  std::vector<BSPTree*> leaves;
+  tree->getLeaves(leaves);
+  preview_part = std::find(leaves.begin(), leaves.end(), leaf) - leaves.begin();
+  preview = new CutPreview(args, tree, leaf);
+  preview->setNormal(0, glm::normalize(uniNorms[0]));
+  printf("PREVIEWING CUTS OF PART %d\n", preview_part);
+  updateTitle();
+}
+
+void GLCanvas::stopPreview() {
+  if (preview == NULL) return;
+  delete preview;
+  preview = NULL;
+  preview_part = -1;
+  updateTitle();
+}
+
+void GLCanvas::movePreview(float delta) {
+  if (preview == NULL) return;
+  float offset = preview->getOffset() + delta;
+  offset = std::max(preview->getMinOffset(), std::min(preview->getMaxOffset(), offset));
+  preview->setOffset(offset);
+  updateTitle();
+  redraw = true;
+}
+
+void GLCanvas::turnPreview(int step) {
+  if (preview == NULL) return;
+  int num_normals = sizeof(uniNorms) / sizeof(uniNorms[0]);
+  int n = (int(preview->getNormalIndex()) + step + num_normals) % num_normals;
+  preview->setNormal(n, glm::normalize(uniNorms[n]));
+  updateTitle();
+}
+
+void GLCanvas::drawPreviewCap() {
+  // The pixels where the previewed part shows its inside through the
+  // plane are those where the ray from the eye crosses what's left of
+  // the (closed) part an odd number of times: count the parity in the
+  // stencil buffer, then draw the plane only there.
+  glEnable(GL_STENCIL_TEST);
+  glClear(GL_STENCIL_BUFFER_BIT);
+  glStencilFunc(GL_ALWAYS, 0, 0xff);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  glDisable(GL_DEPTH_TEST);
+  partitions.drawPart(preview_part);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  glDepthMask(GL_TRUE);
+  glEnable(GL_DEPTH_TEST);
+
+  // a quad on the plane over the whole part
+  const BoundingBox &box = preview->getLeaf()->getMesh().getBoundingBox();
+  const glm::vec3 &n = preview->getNormal();
+  glm::vec3 center;
+  box.getCenter(center);
+  float radius = 0.5f * glm::length(box.getMax() - box.getMin());
+  glm::vec3 origin = center - n * (glm::dot(n, center) - preview->getOffset());
+  glm::vec3 u = glm::normalize(glm::cross(n, (fabs(n.x) < 0.9f) ? glm::vec3(1,0,0) : glm::vec3(0,1,0)));
+  glm::vec3 v = glm::cross(n, u);
+  u *= radius;
+  v *= radius;
+  glStencilFunc(GL_NOTEQUAL, 0, 0xff);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  glUniform1i(GLCanvas::drawingCapID, 1);
+  glUniform3f(GLCanvas::capOriginID, origin.x, origin.y, origin.z);
+  glUniform3f(GLCanvas::capAxisUID, u.x, u.y, u.z);
+  glUniform3f(GLCanvas::capAxisVID, v.x, v.y, v.z);
+  // (the positions come from gl_VertexID, no attributes are used)
+  glBindVertexArray(render_VAO);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glBindVertexArray(0);
+  glUniform1i(GLCanvas::drawingCapID, 0);
+  glDisable(GL_STENCIL_TEST);
+}
+
+void GLCanvas::commitPreview() {
+  if (preview == NULL) return;
+  if (!preview->cutsLeaf()) {
+    printf("the plane misses the part\n");
+    return;
+  }
+  BSPTree *leaf = preview->getLeaf();
+  glm::vec3 normal = preview->getNormal();
+  float offset = preview->getOffset();
+  float grade = preview->getGrade();
+  printf("CUTTING PART %d\n", preview_part);
+  stopPreview();
+  leaf->chop(normal, offset);
+  tree->setGrade(grade);
+  setupVBOs();
+}
+
+// ========================================================
+// Load the vertex, fragment (& geometry) shaders
+// ========================================================
+
+GLuint LoadShaders(const std::string &vertex_file_path,const std::string &fragment_file_path,
+                   const std::string &geometry_file_path){
 
   std::cout << "load shaders" << std::endl;
 
   // Create the shaders
   GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
   GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+  GLuint GeometryShaderID = 0;
 
   // Read the Vertex Shader code from the file
   std::string VertexShaderCode;
@@ -370,6 +711,20 @@ GLuint LoadShaders(const std::string &vertex_file_path,const std::string &fragme
     std::cerr << "ERROR: cannot open " << vertex_file_path << std::endl;
     exit(0);
   }
+  // Read the Geometry Shader code from the file
+  std::string GeometryShaderCode;
+  if (geometry_file_path != "") {
+    std::ifstream GeometryShaderStream(geometry_file_path.c_str(), std::ios::in);
+    if(GeometryShaderStream.is_open()){
+      std::string Line = "";
+      while(getline(GeometryShaderStream, Line))
+        GeometryShaderCode += "\n" + Line;
+      GeometryShaderStream.close();
+    } else {
+      std::cerr << "ERROR: cannot open " << geometry_file_path << std::endl;
+      exit(0);
+    }
+  }
 
   GLint Result = GL_FALSE;
 
@@ -405,11 +760,31 @@ GLuint LoadShaders(const std::string &vertex_file_path,const std::string &fragme
     exit(1);
   }
 
+  // Compile Geometry Shader
+  if (geometry_file_path != "") {
+    std::cout << "Compiling shader : " << geometry_file_path << std::endl;
+    GeometryShaderID = glCreateShader(GL_GEOMETRY_SHADER);
+    char const * GeometrySourcePointer = GeometryShaderCode.c_str();
+    glShaderSource(GeometryShaderID, 1, &GeometrySourcePointer , NULL);
+    glCompileShader(GeometryShaderID);
+
+    // Check Geometry Shader
+    glGetShaderiv(GeometryShaderID, GL_COMPILE_STATUS, &Result);
+    if (Result != GL_TRUE) {
+      GLsizei log_length = 0;
+      GLchar message[1024];
+      glGetShaderInfoLog(GeometryShaderID, 1024, &log_length, message);
+      std::cout << "GEOMETRY ERROR " << message << std::endl;
+      exit(1);
+    }
+  }
+
   // Link the program
   std::cout << "Linking shader program" << std::endl;
   GLuint ProgramID = glCreateProgram();
   glAttachShader(ProgramID, VertexShaderID);
   glAttachShader(ProgramID, FragmentShaderID);
+  if (GeometryShaderID != 0) glAttachShader(ProgramID, GeometryShaderID);
   glLinkProgram(ProgramID);
 
   // Check the program
@@ -424,6 +799,7 @@ GLuint LoadShaders(const std::string &vertex_file_path,const std::string &fragme
 
   glDeleteShader(VertexShaderID);
   glDeleteShader(FragmentShaderID);
+  if (GeometryShaderID != 0) glDeleteShader(GeometryShaderID);
 
   printf("asdf\n");
   return ProgramID;
@@ -479,38 +855,130 @@ int HandleGLError(const std::string &message, bool ignore) {
 // ========================================================
 // ========================================================
 
-bool allAtGoal(const std::vector<BSPTree*> &currentBSPs) {
+// (empty slots are left when there were fewer candidates than the beam
+// width, they don't hold up the search)
+bool allAtGoal(const std::vector<std::unique_ptr<FlatBSPTree> > &currentBSPs) {
+  bool any = false;
   for (unsigned int i = 0; i < currentBSPs.size(); ++i) {
-    if (currentBSPs[i] == NULL ||
-        !currentBSPs[i]->fitsInVolume(GLCanvas::args->printing_width,
-                                      GLCanvas::args->printing_height,
-                                      GLCanvas::args->printing_length)) {
+    if (currentBSPs[i] == NULL) continue;
+    any = true;
+    if (!currentBSPs[i]->fitsInVolume()) {
       return false;
     }
   }
 
-  return true;
+  return any;
 }
 
-BSPTree* GLCanvas::beamSearch(BSPTree* tree) {
+BSPTree* GLCanvas::partition(BSPTree* tree, SearchControl *control) {
+  BSPTree *result = NULL;
+  if (args->plan_file != "" && tree->isLeaf()) {
+    CutPlan plan;
+    if (plan.Load(args->plan_file)) {
+      if (plan.getMeshHash() != tree->getMesh().getSourceHash()) {
+        std::cout << "WARNING: cut plan '" << args->plan_file
+                  << "' was made for a different mesh, searching instead" << std::endl;
+      } else {
+        plan.Replay(tree);
+        std::cout << "replayed cut plan '" << args->plan_file << "' ("
+                  << plan.numParts() << " parts)" << std::endl;
+        result = tree;
+      }
+    }
+  }
+  // an earlier run with the same mesh & search parameters?
+  SearchKey key = MakeSearchKey(tree->getMesh().getSourceHash(), args);
+  if (result == NULL && args->result_cache && tree->isLeaf()) {
+    CutPlan plan;
+    if (LookupResult(ResultCacheDirectory(args), key, plan) &&
+        plan.getMeshHash() == tree->getMesh().getSourceHash()) {
+      plan.Replay(tree);
+      std::cout << "using cached search result (grade " << plan.getNode(0).grade << ", "
+                << plan.numParts() << " parts)" << std::endl;
+      result = tree;
+    }
+  }
+  if (result == NULL) {
+    result = beamSearch(tree, control);
+    if (control != NULL && control->isCancelled()) {
+      // (an unfinished search is neither cached nor saved)
+      return result;
+    }
+    if (args->result_cache && result->getMesh().getSourceHash() != 0) {
+      CutPlan plan;
+      plan.FromTree(result);
+      StoreResult(ResultCacheDirectory(args), (unsigned long long)args->result_cache_mb << 20,
+                  key, plan);
+    }
+  }
+  if (args->save_plan_file != "") {
+    CutPlan plan;
+    plan.FromTree(result);
+    if (plan.Save(args->save_plan_file)) {
+      std::cout << "saved cut plan '" << args->save_plan_file << "'" << std::endl;
+    }
+  }
+  return result;
+}
+
+// one (beam tree, normal) pair of a search iteration: the offsets to
+// cut leaf part at (its cuts are one group of the CutCollector)
+struct CutJob {
+  const FlatBSPTree *tree;
+  unsigned int part;
+  glm::vec3 normal;
+  std::vector<float> offsets;
+};
+
+// index of the best tree of the beam (lowest grade)
+static unsigned int BestTree(const std::vector<std::unique_ptr<FlatBSPTree> > &beam) {
+  unsigned int best = 0;
+  for (unsigned int i = 0; i < beam.size(); ++i) {
+    if (beam[i] == NULL) continue;
+    if (beam[best] == NULL || beam[best]->getGrade() > beam[i]->getGrade()) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+BSPTree* GLCanvas::beamSearch(BSPTree* tree, SearchControl *control) {
   printf("STARTING BEAM SEARCH...\n");
   if (tree->fitsInVolume(args->printing_width, args->printing_height, args->printing_length)) {
     return tree;
   }
+  // the search works on flat trees whose leaf meshes live in one pool
+  // (see flatbsptree.h), the winner is turned back into a BSPTree
+  MeshPool pool;
+
+  // every iteration the cuts of all beam trees are one task graph on
+  // this pool: a task per (tree, normal) finds the offsets to try and
+  // submits them in batches, idle workers steal batches from busy ones
+  ThreadPool scheduler;
+
   // store our search beam in a vector
-  std::vector<BSPTree*> currentBSPs(args->beam_width, NULL);
+  // (the beam owns its trees, everything that drops out of it is freed)
+  std::vector<std::unique_ptr<FlatBSPTree> > currentBSPs(args->beam_width);
 
   // put the input tree into the first spot of currentBSPs
-  currentBSPs[0] = tree;
+  // (spots are only ever refilled, so this one always holds a tree)
+  currentBSPs[0].reset(FlatBSPTree::FromTree(tree, args, &pool));
 
   // continue searching until all trees in currentBSPs fit in the working volume of the printer
   int iterationCounter = 0;
   while (!allAtGoal(currentBSPs) && iterationCounter < 10) {
+    if (control != NULL) {
+      control->WaitWhilePaused();
+      if (control->isCancelled()) break;
+    }
     iterationCounter++;
     printf("\tITERATION %d\n", iterationCounter);
+    if (control != NULL) control->setIteration(iterationCounter);
 
-    // priority queue to store all possible new cuts in order of objective function grade
-    std::priority_queue<BSPTree*, std::vector<BSPTree*>, BSPTreeGreaterThan> newBSPs;
+    // the beam trees being cut this iteration (each stays in the beam
+    // until a new tree takes its place)
+    std::vector<bool> cutSlots(currentBSPs.size(), false);
+    std::vector<CutJob> jobs;
 
     // iterate through all trees in currentBSPs
     for (unsigned int i = 0; i < currentBSPs.size(); ++i) {
@@ -518,62 +986,143 @@ BSPTree* GLCanvas::beamSearch(BSPTree* tree) {
         printf("\t\tcurrentBSPs[%u] is NULL... skipping.\n", i);
         continue;
       }
-      if (currentBSPs[i]->fitsInVolume(args->printing_width,args->printing_height,args->printing_length)) {
+      if (currentBSPs[i]->fitsInVolume()) {
         printf("\t\tcurrentBSPs[%u] fits in the working volume... skipping.\n", i);
         continue;
       }
 
-      // remove the tree from currentBSPs
-      // NOTE we may have to copy and delete
+      // cut the largest leaf of the tree along all the directions
       printf("\t\tCutting currentBSPs[%u].\n", i);
-      BSPTree* t = currentBSPs[i];
-      currentBSPs[i] = NULL;
-
-      // find the largest leaf node of t
-      BSPTree* p = NULL;
-      t->largestPart(args->printing_width, args->printing_height, args->printing_length, p);
-      assert(p != NULL);
-      assert(p->isLeaf());
-
-      // find all candidate cuts for this partition and add it to newBSPs
-      std::priority_queue<BSPTree*, std::vector<BSPTree*>, BSPTreeGreaterThan> resultSet = evalCuts(t,p);
-      while (!resultSet.empty()) {
-        newBSPs.push(resultSet.top());
-        resultSet.pop();
+      cutSlots[i] = true;
+      unsigned int p = currentBSPs[i]->largestPart();
+      for (int n = 0; n < 6; n++) {
+        CutJob job;
+        job.tree = currentBSPs[i].get();
+        job.part = p;
+        job.normal = glm::normalize(uniNorms[n]);
+        jobs.push_back(std::move(job));
       }
+    }
 
-      // delete t;
+    // only the cuts that can still make it into the beam are kept (and
+    // only those are turned into trees), plus a reserve for the
+    // diversity filter below
+    CutCollector collector(jobs.size(), args->beam_width, args->beam_width * BEAM_CUT_RESERVE);
+
+    // (jobs isn't resized any more, the tasks may keep pointers into it)
+    for (unsigned int j = 0; j < jobs.size(); j++) {
+      CutJob *job = &jobs[j];
+      CutCollector *cuts = &collector;
+      unsigned int iteration = iterationCounter;
+      ThreadPool *pool = &scheduler;
+      scheduler.Submit([job, cuts, j, iteration, control, pool]() {
+        // figure out how many cuts we have to make in this particular direction
+        float curOffset, maxOffset;
+        BSPTree::getMinMaxOffsetsAlongNorm(job->tree->getMesh(job->part), job->normal, curOffset, maxOffset);
+        int numSlices = (int)floor((maxOffset - curOffset - args->offset_increment)/args->offset_increment);
+        for (int k = 0; k < numSlices; k++) {
+          curOffset += args->offset_increment;
+          job->offsets.push_back(curOffset);
+        }
+        int numBatches = (numSlices + BEAM_CUTS_PER_TASK - 1) / BEAM_CUTS_PER_TASK;
+        for (int b = 0; b < numBatches; b++) {
+          pool->Submit([job, cuts, j, iteration, control, pool, b]() {
+            if (control != NULL) {
+              control->WaitWhilePaused();
+              if (control->isCancelled()) return;
+            }
+            // (the random mesh colours depend on the work, not the thread)
+            args->seedRandom({iteration, j, (unsigned int)b});
+            // the pool keeps every core busy while there are enough
+            // batches; when a level has fewer, the split of a large leaf
+            // (see BSPTree::SplitMesh) uses the idle ones too (reserved,
+            // so two batches don't both count the same workers)
+            unsigned int reserved = 0;
+#ifdef _OPENMP
+            if (job->tree->getMesh(job->part).numTriangles() >= BSP_PARALLEL_SPLIT_TRIANGLES) {
+              reserved = pool->ReserveIdle();
+            }
+            omp_set_num_threads(1 + reserved);
+#endif
+            int first = b * BEAM_CUTS_PER_TASK;
+            int count = std::min((int)job->offsets.size() - first, BEAM_CUTS_PER_TASK);
+            evalCuts(*job->tree, job->part, job->normal, job->offsets, first, count, *cuts, j);
+            pool->ReleaseIdle(reserved);
+            if (control != NULL) control->addCandidates(count);
+          });
+        }
+      });
+    }
+    // join point: every candidate of this iteration is made
+    scheduler.Wait();
+    if (control != NULL && control->isCancelled()) {
+      // (the beam is left as it was before this iteration)
+      printf("\tSEARCH CANCELLED\n");
+      break;
     }
 
-    // find all empty spots in currentBSPs and fill them with the top
-    // trees from newBSPs
-    for (unsigned int i = 0; i < currentBSPs.size(); ++i) {
-      if (currentBSPs[i] == NULL) {
-        newBSPs.top()->clearNonLeaves();
-        currentBSPs[i] = newBSPs.top();
-        newBSPs.pop();
+    // the new trees, sorted by objective function grade below
+    // (collected in job order, so the result doesn't depend on the schedule)
+    std::vector<std::unique_ptr<FlatBSPTree> > newBSPs;
+    for (unsigned int j = 0; j < jobs.size(); j++) {
+      const glm::vec3 &curNorm = jobs[j].normal;
+      std::vector<CutCandidate> potentialCuts;
+      collector.Take(j, potentialCuts);
+      printf("\t\t\tCut with normal (%f, %f, %f), %d slices, %d kept\n",
+             curNorm.x, curNorm.y, curNorm.z, (int)jobs[j].offsets.size(), (int)potentialCuts.size());
+      filterCuts(potentialCuts);
+      for (unsigned int k = 0; k < potentialCuts.size(); k++) {
+        // the candidate is a copy of the tree (just its node array) with the leaf cut
+        CutCandidate &c = potentialCuts[k];
+        MeshPool *meshes = jobs[j].tree->getPool();
+        std::unique_ptr<FlatBSPTree> candidate(new FlatBSPTree(*jobs[j].tree));
+        candidate->cut(jobs[j].part, c.normal, c.offset,
+                       meshes->Add(c.left.release()), meshes->Add(c.right.release()));
+        candidate->setGrade(c.grade);
+        // (the cut node remembers the grade its cut gave the whole tree)
+        candidate->setNodeGrade(jobs[j].part, c.grade);
+        newBSPs.push_back(std::move(candidate));
       }
     }
+    jobs.clear();
+    if (newBSPs.empty()) {
+      // (no cut of any beam tree is possible, e.g. the offset increment
+      // is coarser than the largest parts)
+      printf("\tNO NEW CUTS\n");
+      break;
+    }
+    std::stable_sort(newBSPs.begin(), newBSPs.end(), FlatBSPTreeLessThan());
+
+    // fill the empty spots & the spots of the cut trees in currentBSPs
+    // with the top trees from newBSPs (a cut tree nothing replaces stays)
+    unsigned int next = 0;
+    for (unsigned int i = 0; i < currentBSPs.size() && next < newBSPs.size(); ++i) {
+      if (currentBSPs[i] == NULL || cutSlots[i]) {
+        currentBSPs[i] = std::move(newBSPs[next++]);
+      }
+    }
+
+    // discard all other trees from newBSPs, and the meshes only they used
+    newBSPs.clear();
+    pool.Collect(currentBSPs);
 
-    // discard all other trees from newBSPs
-    while(!newBSPs.empty()) {
-      BSPTree* temp = newBSPs.top();
-      newBSPs.pop();
-      delete temp;
+    // show the best tree so far (a copy, the search keeps its meshes)
+    if (control != NULL) {
+      unsigned int best = BestTree(currentBSPs);
+      assert(currentBSPs[best] != NULL);
+      control->Publish(currentBSPs[best]->ToTree(true));
     }
   }
 
-  unsigned int bestTreeIndex = 0;
+  unsigned int bestTreeIndex = BestTree(currentBSPs);
   for (unsigned int i = 0; i < currentBSPs.size(); ++i) {
-    if (currentBSPs[bestTreeIndex]->getGrade() > currentBSPs[i]->getGrade()) {
-      bestTreeIndex = i;
-    }
+    if (currentBSPs[i] == NULL) continue;
 
     glm::vec3 d = currentBSPs[i]->getBoundingBoxDims();
 
     printf("largest part dimensions %f %f %f\n", d.x, d.y, d.z);
 
-    if (currentBSPs[i]->fitsInVolume(args->printing_width,args->printing_height,args->printing_length)) {
+    if (currentBSPs[i]->fitsInVolume()) {
       printf("%d fits!\n", i);
     } else {
       printf("%d doesn't fit :(\n", i);
@@ -582,96 +1131,61 @@ BSPTree* GLCanvas::beamSearch(BSPTree* tree) {
 
   printf("FINISHED BEAM SEARCH!\n");
 
-  return currentBSPs[bestTreeIndex];
+  // the rest of the beam (and the pool) is freed on return
+  assert(currentBSPs[bestTreeIndex] != NULL);
+  return currentBSPs[bestTreeIndex]->ToTree();
 }
 
-std::priority_queue<BSPTree*, std::vector<BSPTree*>, BSPTreeGreaterThan> GLCanvas::evalCuts(BSPTree* t, BSPTree* p) {
-  printf("\t\tSTARTED EVALUATING CUTS\n");
-
-  // stores all the cuts we make
-  std::priority_queue<BSPTree*, std::vector<BSPTree*>, BSPTreeGreaterThan> resultSet;
-  // glm::vec3 uniNorm[] = {
-  //   glm::vec3(1,0,0),
-  //   glm::vec3(0,1,0),
-  //   glm::vec3(0,0,1)
-  // };
-
-  // iterate through all the directions
-  // #pragma omp parallel for shared(resultSet)
-  for (int i = 0; i < 6; i+=1) {
-    // BSPTree* t = new BSPTree(*to);
-    // BSPTree* p = NULL;
-    t->largestPart(args->printing_width, args->printing_height, args->printing_length, p);
-    glm::vec3 curNorm = glm::normalize(uniNorms[i]);
-    printf("\t\t\tCutting with normal (%f, %f, %f)...\n", curNorm.x, curNorm.y, curNorm.z);
-
-    // figure out how many cuts we have to make in this particular direction
-    float curOffset, maxOffset;
-    p->getMinMaxOffsetsAlongNorm(curNorm, curOffset, maxOffset);
-
-    printf("\t\t\tnum slices = %f\n", (maxOffset - curOffset - args->offset_increment)/args->offset_increment);
-    // printf("min off %f max off %f\n", curOffset, maxOffset);
-
-    std::priority_queue<BSPTree*, std::vector<BSPTree*>, BSPTreeGreaterThan> potentialCuts;
-
-    int numSlices = (int)floor((maxOffset - curOffset - args->offset_increment)/args->offset_increment);
-    int j = 0;
-
-    while(j < numSlices) {
-      j++;
-      curOffset += args->offset_increment;
-      // glm::vec3 pop = curOffset * curNorm;
-
-      // printf("offset %f, pop %f %f %f\n", curOffset, pop.x, pop.y, pop.z);
-
-      // chop p into two pieces at the plane defined by curNorm and curOffset
-      p->chop(curNorm, curOffset);
-
-      assert(p->leftChild->numVertices() > 0);
-      assert(p->rightChild->numVertices() > 0);
-
-      t->setGrade(args->a_part*t->fPart() + args->a_util*t->fUtil());
-
-      // store in potentialCuts
-      potentialCuts.push(new BSPTree(*t));
+void GLCanvas::evalCuts(const FlatBSPTree &t, unsigned int p, const glm::vec3 &normal,
+                        const std::vector<float> &offsets, int first, int count,
+                        CutCollector &cuts, unsigned int group) {
+  const Mesh &mesh = t.getMesh(p);
+
+  for (int j = first; j < first + count; j++) {
+    // chop p into two pieces at the plane defined by normal and offsets[j]
+    CutCandidate c;
+    c.left.reset(new Mesh(args));
+    c.right.reset(new Mesh(args));
+    BSPTree::SplitMesh(mesh, normal, offsets[j], *c.left, *c.right);
+
+    // grade the cut without copying t, losing cuts are dropped right away
+    c.grade = t.gradeCut(p, *c.left, *c.right);
+    c.order = j;
+    c.normal = normal;
+    c.offset = offsets[j];
+    cuts.Insert(group, std::move(c));
+  }
+}
 
-      // delete p->leftChild;
-      // delete p->rightChild;
-      p->leftChild = NULL;
-      p->rightChild = NULL;
+void GLCanvas::filterCuts(std::vector<CutCandidate> &potentialCuts) {
+  // a cut is kept if the RMS difference of its grade to the grades of
+  // all the better cuts kept so far is large enough.  That RMS is
+  //   sqrt( (grade - mean)^2 + variance )
+  // of the kept grades, so one running mean & variance (Welford's
+  // method, in double) makes the whole filter linear after the sort
+  // instead of comparing against every kept grade
+  // (potentialCuts is sorted best first)
+  double threshold = 0.1 * sqrt(args->printing_width * args->printing_width + args->printing_height * args->printing_height + args->printing_length * args->printing_length);
+  double mean = 0;
+  double m2 = 0;   // sum of squared differences from the mean
+  unsigned int kept = 0;
+  for (unsigned int k = 0; k < potentialCuts.size(); ++k) {
+    double curGrade = potentialCuts[k].grade;
+    bool keep = true;
+    if (kept > 0) {
+      double d = curGrade - mean;
+      keep = sqrt(d*d + m2 / kept) > threshold;
     }
-    std::list<float> prevGrades;
-    while(!potentialCuts.empty()) {
-      if (prevGrades.size() == 0) {
-
-        resultSet.push(potentialCuts.top());
-        prevGrades.push_back(potentialCuts.top()->getGrade());
-        potentialCuts.pop();
-      } else {
-        float rmse = 0;
-        for(std::list<float>::iterator iter = prevGrades.begin(); iter != prevGrades.end(); ++iter) {
-          rmse += (potentialCuts.top()->getGrade() - (*iter)) * (potentialCuts.top()->getGrade() - (*iter));
-        }
-        // printf("RMSE: %f\n", sqrt(rmse / prevGrades.size()));
-        if (sqrt(rmse / prevGrades.size()) > 0.1 * sqrt(args->printing_width * args->printing_width + args->printing_height * args->printing_height + args->printing_length * args->printing_length)) {
-          // potentialCuts.top()->clearNonLeaves();
-          resultSet.push(potentialCuts.top());
-          prevGrades.push_back(potentialCuts.top()->getGrade());
-          potentialCuts.pop();
-        } else {
-          BSPTree* temp = potentialCuts.top();
-          potentialCuts.pop();
-          delete temp;
-        }
-      }
-      // resultSet.push(potentialCuts.top());
-      //   potentialCuts.pop();
+    if (keep) {
+      double d = curGrade - mean;
+      mean += d / (kept + 1);
+      m2 += d * (curGrade - mean);
+      if (kept != k) potentialCuts[kept] = std::move(potentialCuts[k]);
+      kept++;
     }
   }
-
-  printf("\t\tFINISHED EVALUATING CUTS\n");
-
-  return resultSet;
+  // (the others are freed here)
+  potentialCuts.resize(kept);
 }
 
 glm::vec3 GLCanvas::uniNorms[129] = {
@@ -16,13 +16,21 @@
 #include <string>
 #include <list>
 #include <queue>
+#include <memory>
+#include <thread>
 
 #include "boundingbox.h"
+#include "partitionbuffers.h"
 
 class ArgParser;
 class Camera;
 class BSPTree;
-class BSPTreeGreaterThan;
+class FlatBSPTree;
+class CutCollector;
+class SearchControl;
+class FrameTimer;
+class CutPreview;
+struct CutCandidate;
 // class Mesh;
 
 // ====================================================================
@@ -49,6 +57,14 @@ public:
   static GLuint programID;
   static GLuint colormodeID;
   static GLuint wireframeID;
+  static GLuint gouraudID;
+  static GLuint previewPlaneID;
+  static GLuint previewPartID;
+  static GLuint previewClipID;
+  static GLuint drawingCapID;
+  static GLuint capOriginID;
+  static GLuint capAxisUID;
+  static GLuint capAxisVID;
 
   // mouse position
   static int mouseX;
@@ -64,6 +80,26 @@ public:
   static bool superKeyPressed;
 
   static GLuint render_VAO;
+  // the leaves of tree, drawn all at once
+  static PartitionBuffers partitions;
+
+  // the beam search started with 'c' runs on search_thread (NULL when
+  // no search is running)
+  static SearchControl *search;
+  static std::thread search_thread;
+
+  // something changed & the window needs drawing again (unless
+  // args->continuous, frames are only drawn when this is set)
+  static bool redraw;
+  // -frame_timing (NULL otherwise)
+  static FrameTimer *frame_timer;
+
+  // the cut being previewed with 'v' (NULL when not previewing) & the
+  // part number of its leaf
+  static CutPreview *preview;
+  static int preview_part;
+  // cut the previewed part open along the plane (on the GPU only)
+  static bool preview_clip;
 
   static void initialize(ArgParser *_args);
   static void initializeVBOs();
@@ -73,15 +109,50 @@ public:
 
   static void animate();
 
+  // background search: start on a copy of the tree, every frame swap in
+  // its latest best tree & show the progress, stop it before exiting
+  static void startSearch();
+  static void updateSearch();
+  static void stopSearch();
+  // the window title, with the search progress & the frame timing
+  static void updateTitle();
+
+  // interactive cut preview of the largest part: start, move or turn
+  // the plane, cut there for real (which ends the preview)
+  static void startPreview();
+  static void stopPreview();
+  static void movePreview(float delta);
+  static void turnPreview(int step);
+  static void commitPreview();
+  // the cut face of the clipped part
+  static void drawPreviewCap();
+
   // Callback functions for mouse and keyboard events
   static void mousebuttonCB(GLFWwindow *window, int which_button, int action, int mods);
   static void mousemotionCB(GLFWwindow *window, double x, double y);
   static void keyboardCB(GLFWwindow *window, int key, int scancode, int action, int mods);
+  static void windowrefreshCB(GLFWwindow *window);
   static void error_callback(int error, const char* description);
 
-  // Run beam search algorithm
-  static BSPTree* beamSearch(BSPTree* tree);
-  static std::priority_queue<BSPTree*, std::vector<BSPTree*>, BSPTreeGreaterThan> evalCuts(BSPTree* t, BSPTree* p);
+  // Cut the mesh into printable partitions: replays args->plan_file if
+  // given, or a cached result of the same job, otherwise runs the beam
+  // search (and caches it).  Saves args->save_plan_file.  Takes
+  // ownership of tree, which is either returned or deleted.  With a
+  // control the search can be paused & cancelled (a cancelled search
+  // returns its best tree so far, which isn't cached or saved) and
+  // publishes its progress.
+  static BSPTree* partition(BSPTree* tree, SearchControl *control = NULL);
+  // Run beam search algorithm (takes ownership of tree like partition)
+  static BSPTree* beamSearch(BSPTree* tree, SearchControl *control = NULL);
+  // cuts leaf p of t at offsets[first .. first+count-1] along normal,
+  // grades each cut & offers it to group of cuts (runs on the beam
+  // search's worker threads)
+  static void evalCuts(const FlatBSPTree &t, unsigned int p, const glm::vec3 &normal,
+                       const std::vector<float> &offsets, int first, int count,
+                       CutCollector &cuts, unsigned int group);
+  // drops the cuts of potentialCuts (sorted best first) whose grades
+  // don't differ enough from the better ones kept
+  static void filterCuts(std::vector<CutCandidate> &potentialCuts);
 
   static glm::vec3 uniNorms[129];
 };
@@ -89,9 +160,11 @@ public:
 // ====================================================================
 
 // helper functions
-GLuint LoadShaders(const std::string &vertex_file_path,const std::string &fragment_file_path);
+// (no geometry shader if its path is "")
+GLuint LoadShaders(const std::string &vertex_file_path,const std::string &fragment_file_path,
+                   const std::string &geometry_file_path = "");
 std::string WhichGLError(GLenum &error);
 int HandleGLError(const std::string &message = "", bool ignore = false);
-bool allAtGoal(const std::vector<BSPTree*> &currentBSPs);
+bool allAtGoal(const std::vector<std::unique_ptr<FlatBSPTree> > &currentBSPs);
 
 #endif
@@ -1,10 +1,14 @@
 #version 330 core
 
-// Interpolated values from the vertex shader
+// Interpolated values from the geometry shader
 in vec3 vertexPosition_worldspace;
 in vec3 EyeDirection_cameraspace;
 in vec3 myColor;
 in vec3 vertexNormal_worldspace;
+in vec3 barycentric;
+flat in uint edgeFlags;
+in float previewDistance;
+flat in int previewing;
 
 // Ouput data
 out vec3 color;
@@ -13,44 +17,59 @@ out vec3 color;
 uniform vec3 LightPosition_worldspace;
 uniform int colormode;
 uniform int wireframe;
+// (0 = flat shading, the vertices have no normals)
+uniform int gouraud;
+// 1 = cut away the side of the previewed part the plane normal points to
+uniform int previewClip;
 
 
 // ----------------------------------------------
 void main(){
 
+  if (previewing == 1 && previewClip == 1 && previewDistance > 0.0) {
+    discard;
+  }
+
   vec3 LightColor = vec3(1,1,1);
   float LightPower = 4.0f;
 
   // surface normal
   vec3 surface_normal =  vertexNormal_worldspace;
+  if (gouraud == 0) {
+    // the normal of the triangle, from the screen space derivatives
+    // (that one always faces the camera, it's flipped back below)
+    surface_normal = normalize(cross(dFdx(vertexPosition_worldspace),
+                                     dFdy(vertexPosition_worldspace)));
+    if (!gl_FrontFacing) surface_normal = -surface_normal;
+  }
 
   // Material properties
   vec3 MaterialDiffuseColor = myColor;
 
-  //wireframe shading
-  // if (wireframe == 1) {
-  //     if (myColor.x < 0.1 &&
-  //         myColor.y < 0.1 &&
-  //         myColor.z < 0.1) {
-  //       MaterialDiffuseColor *= 0.6 * vec3(1,1,1);
-  //     }
-  // }
-
-  //this creates the nice wireframe but also makes everything gray
-  if ( (wireframe == 1) &&
-       ( myColor.x > 0.1 &&
-         myColor.y > 0.1 &&
-         myColor.z > 0.1) ) {
-    MaterialDiffuseColor = 0.6 * vec3(1,1,1);
-  } else {
-    if (myColor.x < 0.1 &&
-        myColor.y < 0.1 &&
-        myColor.z < 0.1) {
-      // MaterialDiffuseColor *= 7.0;
-      MaterialDiffuseColor = vec3(0.0,0.0,0.0);
+  // wireframe: darken the fragments near an edge of the triangle,
+  // boundary edges are red & crease edges are yellow
+  if (wireframe == 1) {
+    // (distance to edge ab is the c coordinate, and so on)
+    vec3 dist = barycentric.zxy;
+    // about a pixel & a half wide whatever the size of the triangle
+    vec3 lines = 1.0 - smoothstep(vec3(0.0), 1.5 * fwidth(dist), dist);
+    for (int i = 0; i < 3; i++) {
+      uint flag = (edgeFlags >> uint(2*i)) & 3u;
+      vec3 edgeColor = vec3(0.0,0.0,0.0);
+      if (flag == 1u) edgeColor = vec3(1.0,1.0,0.0);
+      if (flag == 2u) edgeColor = vec3(1.0,0.0,0.0);
+      MaterialDiffuseColor = mix(MaterialDiffuseColor, edgeColor, lines[i]);
     }
   }
 
+  // cut preview: tint the two halves of the part & draw the cut line
+  if (previewing == 1) {
+    vec3 tint = (previewDistance < 0.0) ? vec3(0.2,0.4,1.0) : vec3(1.0,0.5,0.1);
+    MaterialDiffuseColor = mix(MaterialDiffuseColor, tint, 0.5);
+    float line = 1.0 - smoothstep(0.0, 1.5 * fwidth(previewDistance), abs(previewDistance));
+    MaterialDiffuseColor = mix(MaterialDiffuseColor, vec3(0.0,0.0,0.0), line);
+  }
+
   vec3 MaterialAmbientColor = vec3(0.3,0.3,0.3) * MaterialDiffuseColor;
   vec3 MaterialSpecularColor = vec3(0.3,0.3,0.3);
   if(!gl_FrontFacing ) {
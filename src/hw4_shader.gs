@@ -0,0 +1,62 @@
+#version 330 core
+
+// Passes the triangles of the vertex shader through, adding what the
+// wireframe needs: the barycentric coordinates of every corner & the
+// kinds of the three edges of the triangle (see partitionbuffers.h).
+// The vertices are shared between triangles, so neither can come from
+// the vertex data.
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+in VertexData {
+  vec3 vertexPosition_worldspace;
+  vec3 vertexNormal_worldspace;
+  vec3 EyeDirection_cameraspace;
+  vec3 myColor;
+  float previewDistance;
+  flat int previewing;
+} vertex[];
+
+// Output data, to the fragment shader
+out vec3 vertexPosition_worldspace;
+out vec3 vertexNormal_worldspace;
+out vec3 EyeDirection_cameraspace;
+out vec3 myColor;
+// (the barycentric coordinates of the fragment, for the wireframe)
+out vec3 barycentric;
+flat out uint edgeFlags;
+out float previewDistance;
+flat out int previewing;
+
+uniform int wireframe;
+// 1 = the cap of the cut preview (it has no edges)
+uniform int drawingCap;
+
+// the kinds of the edges of every triangle, in the order of the index
+// buffer, & the triangle this draw starts at (gl_PrimitiveIDIn counts
+// from 0 in every draw call)
+uniform usamplerBuffer triangleEdges;
+uniform int firstTriangle;
+
+void main(){
+
+  uint edges = 0u;
+  if (wireframe == 1 && drawingCap == 0) {
+    edges = texelFetch(triangleEdges, firstTriangle + gl_PrimitiveIDIn).r;
+  }
+
+  for (int i = 0; i < 3; i++) {
+    gl_Position = gl_in[i].gl_Position;
+    vertexPosition_worldspace = vertex[i].vertexPosition_worldspace;
+    vertexNormal_worldspace = vertex[i].vertexNormal_worldspace;
+    EyeDirection_cameraspace = vertex[i].EyeDirection_cameraspace;
+    myColor = vertex[i].myColor;
+    barycentric = vec3(i == 0, i == 1, i == 2);
+    if (drawingCap == 1) barycentric = vec3(1.0/3.0);
+    edgeFlags = edges;
+    previewDistance = vertex[i].previewDistance;
+    previewing = vertex[i].previewing;
+    EmitVertex();
+  }
+  EndPrimitive();
+}
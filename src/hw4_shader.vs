@@ -3,14 +3,20 @@
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec3 vertexNormal_modelspace;
-layout(location = 2) in vec3 vertexColor;
+// the part this vertex belongs to (see vbo_structs.h)
+layout(location = 2) in uint vertexPart;
 
-// Output data
-out vec3 vertexPosition_worldspace;
-out vec3 vertexNormal_worldspace;
-out vec3 vertexNormal_cameraspace;
-out vec3 EyeDirection_cameraspace;
-out vec3 myColor;
+// Output data, to the geometry shader
+out VertexData {
+  vec3 vertexPosition_worldspace;
+  vec3 vertexNormal_worldspace;
+  vec3 EyeDirection_cameraspace;
+  vec3 myColor;
+  // (signed distance to the plane of the cut preview, if this part is
+  // being previewed)
+  float previewDistance;
+  flat int previewing;
+} vertex;
 
 // Values that stay constant for the whole mesh.
 uniform mat4 MVP;
@@ -18,24 +24,53 @@ uniform mat4 V;
 uniform mat4 M;
 uniform vec3 LightPosition_worldspace;
 
-uniform int wireframe;
+// the plane of the cut preview (normal, offset) & the part it cuts
+// (-1 = no preview)
+uniform vec4 previewPlane;
+uniform int previewPart;
+// 1 = draw the cap of the clipped part instead: a quad on the plane
+// (origin +- axis u +- axis v), made from gl_VertexID
+uniform int drawingCap;
+uniform vec3 capOrigin;
+uniform vec3 capAxisU;
+uniform vec3 capAxisV;
+
+// the colour of every part (see partitionbuffers.h)
+layout(std140) uniform PartColors {
+  vec4 partColors[1024];
+};
 
 void main(){
 
+  vec3 position = vertexPosition_modelspace;
+  vec3 normal = vertexNormal_modelspace;
+  uint part = vertexPart;
+  if (drawingCap == 1) {
+    // (a triangle strip of 4 corners)
+    float u = float(gl_VertexID & 1) * 2.0 - 1.0;
+    float v = float(gl_VertexID >> 1) * 2.0 - 1.0;
+    position = capOrigin + u * capAxisU + v * capAxisV;
+    normal = previewPlane.xyz;
+    part = uint(previewPart);
+  }
+
   // Output position of the vertex, in clip space : MVP * position
-  gl_Position =  MVP * vec4(vertexPosition_modelspace,1);
+  gl_Position =  MVP * vec4(position,1);
 
   // Position of the vertex, in worldspace : M * position
-  vertexPosition_worldspace = (M * vec4(vertexPosition_modelspace,1)).xyz;
+  vertex.vertexPosition_worldspace = (M * vec4(position,1)).xyz;
 
   // Vector that goes from the vertex to the camera, in camera space.
   // In camera space, the camera is at the origin (0,0,0).
-  vec3 vertexPosition_cameraspace = ( V * M * vec4(vertexPosition_modelspace,1)).xyz;
+  vec3 vertexPosition_cameraspace = ( V * M * vec4(position,1)).xyz;
 
-  EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_cameraspace;
+  vertex.EyeDirection_cameraspace = vec3(0,0,0) - vertexPosition_cameraspace;
 
-  vertexNormal_worldspace = normalize (M * vec4(vertexNormal_modelspace,0)).xyz;
+  vertex.vertexNormal_worldspace = normalize (M * vec4(normal,0)).xyz;
 
   // pass color to the fragment shader
-  myColor = vertexColor;
+  vertex.myColor = partColors[part % 1024u].rgb;
+
+  vertex.previewing = int(drawingCap == 0 && previewPart >= 0 && uint(previewPart) == part);
+  vertex.previewDistance = dot(previewPlane.xyz, position) - previewPlane.w;
 }
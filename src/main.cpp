@@ -16,9 +16,34 @@
 #include "argparser.h"
 #include "glCanvas.h"
 #include "camera.h"
+#include "bsptree.h"
+#include "exporter.h"
+#include "thumbnail.h"
+#include "frametimer.h"
 
 #include <time.h>
 
+// ====================================================================
+// -batch: cut the mesh & write the partitions without opening a window
+// ====================================================================
+
+int RunBatch(ArgParser *args) {
+  GLCanvas::args = args;
+  BSPTree *tree = new BSPTree(args);
+  tree->Load();
+  if (tree->numVertices() == 0) {
+    return EXIT_FAILURE;
+  }
+  tree = GLCanvas::partition(tree);
+  int num_written = WritePartitions(tree, args);
+  bool thumbnail_ok = true;
+  if (args->thumbnail_file != "") {
+    thumbnail_ok = WriteThumbnail(tree, args);
+  }
+  delete tree;
+  return (num_written > 0 && thumbnail_ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 // ====================================================================
 // ====================================================================
 
@@ -27,6 +52,9 @@ int main(int argc, char *argv[]) {
 
   // parse the command line arguments
   ArgParser args(argc, argv);
+  if (args.batch) {
+    return RunBatch(&args);
+  }
   GLCanvas::initialize(&args);
 
   // glClearColor(0.8,0.9,1.0,0.0);  // light blue sky
@@ -36,34 +64,57 @@ int main(int argc, char *argv[]) {
 
   while (!glfwWindowShouldClose(GLCanvas::window))  {
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(GLCanvas::programID);
-    GLCanvas::camera->glPlaceCamera();
-    glm::vec3 center;
-    GLCanvas::bbox.getCenter(center);
-    glm::mat4 myTranslateMatrix = glm::translate(-center);
-    double maxDim = GLCanvas::bbox.maxDim();
-    float scaleFactor = 2.0 / float(maxDim);
-    glm::mat4 myScalingMatrix = glm::scale(glm::vec3(scaleFactor,scaleFactor,scaleFactor));
-    glm::mat4 ModelMatrix = myScalingMatrix*myTranslateMatrix;
-    // Build the matrix to position the camera based on keyboard and mouse input
-    glm::mat4 ProjectionMatrix = GLCanvas::camera->getProjectionMatrix();
-    glm::mat4 ViewMatrix = GLCanvas::camera->getViewMatrix();
-    GLCanvas::drawVBOs(ProjectionMatrix,ViewMatrix,ModelMatrix);
-    // Swap buffers
-    glfwSwapBuffers(GLCanvas::window);
-    fflush(stdout);
-    glfwPollEvents();
+    // swap in the latest tree of a running search
+    GLCanvas::updateSearch();
+
+    // (only when something changed, unless -continuous)
+    if (args.continuous || GLCanvas::redraw) {
+      GLCanvas::redraw = false;
+      if (GLCanvas::frame_timer != NULL) GLCanvas::frame_timer->beginFrame();
+
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      glUseProgram(GLCanvas::programID);
+      GLCanvas::camera->glPlaceCamera();
+      glm::vec3 center;
+      GLCanvas::bbox.getCenter(center);
+      glm::mat4 myTranslateMatrix = glm::translate(-center);
+      double maxDim = GLCanvas::bbox.maxDim();
+      float scaleFactor = 2.0 / float(maxDim);
+      glm::mat4 myScalingMatrix = glm::scale(glm::vec3(scaleFactor,scaleFactor,scaleFactor));
+      glm::mat4 ModelMatrix = myScalingMatrix*myTranslateMatrix;
+      // Build the matrix to position the camera based on keyboard and mouse input
+      glm::mat4 ProjectionMatrix = GLCanvas::camera->getProjectionMatrix();
+      glm::mat4 ViewMatrix = GLCanvas::camera->getViewMatrix();
+      GLCanvas::drawVBOs(ProjectionMatrix,ViewMatrix,ModelMatrix);
+
+      if (GLCanvas::frame_timer != NULL) GLCanvas::frame_timer->endFrame();
+      // Swap buffers
+      glfwSwapBuffers(GLCanvas::window);
+    }
+    if (GLCanvas::frame_timer != NULL && GLCanvas::frame_timer->Update()) {
+      GLCanvas::updateTitle();
+    }
     fflush(stdout);
 
+    if (args.continuous) {
+      glfwPollEvents();
 #if defined(_WIN32)
-  Sleep(10);
+      Sleep(10);
 #else
-  usleep(10);
+      usleep(10);
 #endif
-
+    } else if (GLCanvas::search != NULL || GLCanvas::frame_timer != NULL) {
+      // (wakes up now & then for the search snapshots & progress, and
+      // the timer queries of the last frame)
+      glfwWaitEventsTimeout(0.1);
+    } else {
+      // sleep until there's input
+      glfwWaitEvents();
+    }
+    fflush(stdout);
   }
 
+  GLCanvas::stopSearch();
   GLCanvas::cleanupVBOs();
   glDeleteProgram(GLCanvas::programID);
 
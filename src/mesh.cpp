@@ -1,4 +1,6 @@
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <string.h>
 
 #include "mesh.h"
@@ -7,34 +9,38 @@
 #include "vertex.h"
 #include "triangle.h"
 #include "argparser.h"
-
-int Triangle::next_triangle_id = 0;
+#include "meshio.h"
+#include "meshcache.h"
 
 // =======================================================================
 // MESH COPY CONSTRUCTOR
 // =======================================================================
+
 Mesh::Mesh(const Mesh &oldMesh) {
   args = oldMesh.args;
   meshColor = oldMesh.meshColor;
+  source_hash = oldMesh.source_hash;
+  bbox_valid = false;
+  next_triangle_id = 0;
+  mesh_id = NextID();
+  vbo_dirty = true;
+  copyGeometry(oldMesh);
+}
 
-  // copy all vertices
-  // this has the added benefit of copying our bounding box
-  for (unsigned int i = 0; i < oldMesh.vertices.size(); ++i) {
-    addVertex(oldMesh.vertices[i]->getPos());
-  }
-
-  // copy all triangles and edges
-  for (triangleshashtype::const_iterator iter = oldMesh.triangles.begin(); iter != oldMesh.triangles.end(); ++iter) {
-    Triangle* t = iter->second;
-    Vertex* a = vertices[(*t)[0]->getIndex()];
-    Vertex* b = vertices[(*t)[1]->getIndex()];
-    Vertex* c = vertices[(*t)[2]->getIndex()];
-    addTriangle(a,b,c);
-  }
+// =======================================================================
+// MESH MOVE CONSTRUCTOR
+// =======================================================================
 
-  // copying the dimensions of the old bounding box because we don't want to the extra
-  // vertices from the pruned triangles to influence the bounding box
-  bbox.Set(oldMesh.bbox.getMin(), oldMesh.bbox.getMax());
+// takes over the half-edge structure of oldMesh, which is left empty
+Mesh::Mesh(Mesh &&oldMesh) {
+  args = oldMesh.args;
+  meshColor = oldMesh.meshColor;
+  source_hash = oldMesh.source_hash;
+  bbox_valid = false;
+  next_triangle_id = 0;
+  mesh_id = NextID();
+  vbo_dirty = true;
+  takeGeometry(oldMesh);
 }
 
 // =======================================================================
@@ -63,17 +69,44 @@ void Mesh::clear() {
   for (int i = 0; i < num_vertices; i++) {
     delete vertices[i];
   }
-  cleanupVBOs();
+  vertices.clear();
+  vertex_parents.clear();
+  next_triangle_id = 0;
+  bbox_valid = false;
+  vbo_dirty = true;
   // printf("fdklj\n");
 }
 
 // ASSIGNMENT OPERATOR
+// (replaces the contents of this mesh, it used to append to them)
 Mesh& Mesh::operator= (const Mesh& oldMesh) {
+  if (this == &oldMesh) return *this;
+  clear();
+  args = oldMesh.args;
+  meshColor = oldMesh.meshColor;
+  source_hash = oldMesh.source_hash;
+  copyGeometry(oldMesh);
+  return *this;
+}
+
+// MOVE ASSIGNMENT OPERATOR
+Mesh& Mesh::operator= (Mesh&& oldMesh) {
+  if (this == &oldMesh) return *this;
+  clear();
   args = oldMesh.args;
   meshColor = oldMesh.meshColor;
+  source_hash = oldMesh.source_hash;
+  takeGeometry(oldMesh);
+  return *this;
+}
+
+// deep copies the vertices & triangles of oldMesh into this (empty) mesh
+void Mesh::copyGeometry(const Mesh &oldMesh) {
+  assert (vertices.empty() && triangles.empty());
 
   // copy all vertices
   // this has the added benefit of copying our bounding box
+  vertices.reserve(oldMesh.vertices.size());
   for (unsigned int i = 0; i < oldMesh.vertices.size(); ++i) {
     addVertex(oldMesh.vertices[i]->getPos());
   }
@@ -87,7 +120,32 @@ Mesh& Mesh::operator= (const Mesh& oldMesh) {
     addTriangle(a,b,c);
   }
 
-  return *this;
+  // copying the dimensions of the old bounding box because we don't want to the extra
+  // vertices from the pruned triangles to influence the bounding box
+  bbox.Set(oldMesh.bbox.getMin(), oldMesh.bbox.getMax());
+  bbox_valid = oldMesh.bbox_valid;
+}
+
+// steals the vertices & triangles of oldMesh, leaving it empty
+// (nothing is copied; the half-edge structure doesn't point back at
+// its mesh)
+void Mesh::takeGeometry(Mesh &oldMesh) {
+  assert (vertices.empty() && triangles.empty());
+  vertices.swap(oldMesh.vertices);
+  edges.swap(oldMesh.edges);
+  triangles.swap(oldMesh.triangles);
+  vertex_parents.swap(oldMesh.vertex_parents);
+  std::swap(next_triangle_id, oldMesh.next_triangle_id);
+  bbox.Set(oldMesh.bbox.getMin(), oldMesh.bbox.getMax());
+  bbox_valid = oldMesh.bbox_valid;
+  oldMesh.bbox_valid = false;
+  vbo_dirty = oldMesh.vbo_dirty = true;
+}
+
+// (the meshes of the search are made on several threads)
+unsigned int Mesh::NextID() {
+  static std::atomic<unsigned int> next_id(1);
+  return next_id++;
 }
 
 // =======================================================================
@@ -95,25 +153,22 @@ Mesh& Mesh::operator= (const Mesh& oldMesh) {
 // =======================================================================
 
 Vertex* Mesh::addVertex(const glm::vec3 &position) {
-  int index = numVertices();
-  Vertex *v = new Vertex(index, position);
-  vertices.push_back(v);
-  if (numVertices() == 1)
-    bbox = BoundingBox(position,position);
-  else
-    bbox.Extend(position);
-  return v;
+  return addVertex(position, true);
 }
 
 Vertex* Mesh::addVertex(const glm::vec3 &position, bool addToBoundingBox) {
   int index = numVertices();
   Vertex *v = new Vertex(index, position);
   vertices.push_back(v);
+  vbo_dirty = true;
   if (addToBoundingBox) {
-    if (numVertices() == 1)
+    // (the first vertices may have been left out of the bounding box,
+    // so start it at the first one that counts, not at vertex 0)
+    if (!bbox_valid)
       bbox = BoundingBox(position,position);
     else
       bbox.Extend(position);
+    bbox_valid = true;
   }
   return v;
 }
@@ -124,7 +179,7 @@ Triangle* Mesh::addTriangle(Vertex *a, Vertex *b, Vertex *c) {
   assert(b != NULL);
   assert(c != NULL);
   // create the triangle
-  Triangle *t = new Triangle();
+  Triangle *t = new Triangle(next_triangle_id++);
   // create the edges
   Edge *ea = new Edge(a,b,t);
   Edge *eb = new Edge(b,c,t);
@@ -154,6 +209,7 @@ Triangle* Mesh::addTriangle(Vertex *a, Vertex *b, Vertex *c) {
   // add the triangle to the master list
   assert (triangles.find(t->getID()) == triangles.end());
   triangles[t->getID()] = t;
+  vbo_dirty = true;
 
   return t;
 }
@@ -171,6 +227,7 @@ void Mesh::removeTriangle(Triangle *t) {
   edges.erase(std::make_pair(b,c));
   edges.erase(std::make_pair(c,a));
   triangles.erase(t->getID());
+  vbo_dirty = true;
   // clean up memory
   delete ea;
   delete eb;
@@ -201,61 +258,113 @@ void Mesh::setParentsChild(Vertex *p1, Vertex *p2, Vertex *child) {
 }
 
 // =======================================================================
-// the load function parses very simple .obj files
+// Build creates all the vertices, triangles & half-edges at once.  The
+// hash tables are sized up front and opposite half-edges are connected
+// from a precomputed table (see ComputeOpposites), instead of probing
+// the edge hash table for every triangle as addTriangle does.
+// =======================================================================
+
+void Mesh::Build(const glm::vec3 *positions, int num_vertices,
+                 const unsigned int *indices, int num_triangles,
+                 const int *opposites) {
+  clear();
+
+  std::vector<int> computed_opposites;
+  if (opposites == NULL) {
+    ComputeOpposites(indices, num_triangles, computed_opposites);
+    opposites = computed_opposites.data();
+  }
+
+  vertices.reserve(num_vertices);
+  for (int i = 0; i < num_vertices; i++) {
+    addVertex(positions[i]);
+  }
+
+  edges.reserve(3*num_triangles);
+  triangles.reserve(num_triangles);
+  std::vector<Edge*> half_edges(3*num_triangles);
+  for (int i = 0; i < num_triangles; i++) {
+    Vertex *a = getVertex(indices[3*i]);
+    Vertex *b = getVertex(indices[3*i+1]);
+    Vertex *c = getVertex(indices[3*i+2]);
+    Triangle *t = new Triangle(next_triangle_id++);
+    Edge *ea = new Edge(a,b,t);
+    Edge *eb = new Edge(b,c,t);
+    Edge *ec = new Edge(c,a,t);
+    t->setEdge(ea);
+    ea->setNext(eb);
+    eb->setNext(ec);
+    ec->setNext(ea);
+    // (a duplicate would be a bug, or a non-manifold mesh)
+    bool inserted_a = edges.insert(std::make_pair(std::make_pair(a,b),ea)).second;
+    bool inserted_b = edges.insert(std::make_pair(std::make_pair(b,c),eb)).second;
+    bool inserted_c = edges.insert(std::make_pair(std::make_pair(c,a),ec)).second;
+    assert (inserted_a && inserted_b && inserted_c);
+    triangles[t->getID()] = t;
+    half_edges[3*i] = ea;
+    half_edges[3*i+1] = eb;
+    half_edges[3*i+2] = ec;
+  }
+
+  for (int i = 0; i < 3*num_triangles; i++) {
+    int j = opposites[i];
+    if (j > i) {
+      assert (j < 3*num_triangles && opposites[j] == i);
+      half_edges[i]->setOpposite(half_edges[j]);
+    }
+  }
+}
+
+// =======================================================================
+// the load function reads .obj & .stl files (see meshio.cpp).  The
+// parsed mesh is stored in a binary cache file next to the input, which
+// later runs map and build from directly (see meshcache.h).
 // =======================================================================
 
 void Mesh::Load() {
   std::string input_file = args->path + "/" + args->input_file;
 
-  FILE *objfile = fopen(input_file.c_str(),"r");
-  if (objfile == NULL) {
+  MappedFile source;
+  if (!source.Open(input_file)) {
     std::cout << "ERROR! CANNOT OPEN '" << input_file << "'\n";
     return;
   }
-
-  char line[200] = "";
-  char token[100] = "";
-  char atoken[100] = "";
-  char btoken[100] = "";
-  char ctoken[100] = "";
-  float x,y,z;
-  int a,b,c,d,e;
-
-  int index = 0;
-  int vert_count = 0;
-  int vert_index = 1;
-
-  while (fgets(line, 200, objfile)) {
-    int token_count = sscanf (line, "%s\n",token);
-    if (token_count == -1) continue;
-    a = b = c = d = e = -1;
-    if (!strcmp(token,"usemtl") ||
-	!strcmp(token,"g")) {
-      vert_index = 1;
-      index++;
-    } else if (!strcmp(token,"v")) {
-      vert_count++;
-      sscanf (line, "%s %f %f %f\n",token,&x,&y,&z);
-      addVertex(glm::vec3(x,y,z));
-    } else if (!strcmp(token,"f")) {
-      int num = sscanf (line, "%s %s %s %s\n",token,
-			atoken,btoken,ctoken);
-      sscanf (atoken,"%d",&a);
-      sscanf (btoken,"%d",&b);
-      sscanf (ctoken,"%d",&c);
-      assert (num == 4);
-      a -= vert_index;
-      b -= vert_index;
-      c -= vert_index;
-      assert (a >= 0 && a < numVertices());
-      assert (b >= 0 && b < numVertices());
-      assert (c >= 0 && c < numVertices());
-      addTriangle(getVertex(a),getVertex(b),getVertex(c));
-    } else if (!strcmp(token,"vt")) {
-    } else if (!strcmp(token,"vn")) {
-    } else if (token[0] == '#') {
-    } else {
-      printf ("LINE: '%s'",line);
+  source_hash = HashBytes(source.data(), source.size());
+  std::string cache_file = input_file + MESH_CACHE_EXTENSION;
+  float weld_tolerance = args->effectiveWeldTolerance();
+
+  MeshCacheFile cache;
+  if (args->mesh_cache && cache.Open(cache_file, source.size(), source_hash, weld_tolerance)) {
+    Build(cache.positions(), cache.numVertices(),
+          cache.indices(), cache.numTriangles(), cache.opposites());
+    std::cout << "using mesh cache '" << cache_file << "'" << std::endl;
+  } else {
+    IndexedMesh data;
+    if (!ParseMeshFile(input_file, source.data(), source.size(), data)) {
+      return;
+    }
+    // merge the duplicated corners (every .stl, many .obj files) before
+    // the half-edge structure is built, so that neighboring triangles
+    // actually share their edges
+    if (weld_tolerance >= 0) {
+      int num_merged = WeldVertices(data, weld_tolerance);
+      if (num_merged > 0) {
+        std::cout << "welded " << num_merged << " duplicate vertices" << std::endl;
+      }
+    }
+    // (Build can't connect a directed edge shared by two triangles)
+    int num_unwelded = UnweldDuplicateEdges(data);
+    if (num_unwelded > 0) {
+      std::cout << "WARNING: " << num_unwelded << " triangles repeat an edge of another triangle"
+                << " (non-manifold or inconsistently wound), they are left unconnected" << std::endl;
+    }
+    std::vector<int> opposites;
+    ComputeOpposites(data.indices.data(), data.numTriangles(), opposites);
+    Build(data.positions.data(), data.numVertices(),
+          data.indices.data(), data.numTriangles(), opposites.data());
+    if (args->mesh_cache) {
+      WriteMeshCache(cache_file, source.size(), source_hash, weld_tolerance,
+                     data, opposites);
     }
   }
 
@@ -265,53 +374,107 @@ void Mesh::Load() {
 }
 
 // =======================================================================
-// this function outputs scene into a very simple .obj file
+// writes the triangles of this mesh as a binary .stl file
 // =======================================================================
 
-// void Mesh::OutputFile() {
-//   std::string output_file = args->path + "/output.obj";
-//
-//   FILE *objfile = fopen(output_file.c_str(),"w");
-//   if (objfile == NULL) {
-//     std::cout << "ERROR! CANNOT OPEN '" << output_file << "'\n";
-//     return;
-//   }
-//
-//   //loop through all the vertices and write all vertices of one object
-//   //after finishing the vertices of an object, create a group
-//   //then loop through the indices of the faces of this object and print them
-//
-//   int indexStart = 0;  //index of the starting face of each object
-//
-//   for (unsigned int i=0; i<vertices.size(); i++) {
-//     unsigned int j;
-//
-//     //writing the vertices in this object to the file
-//     for (j=0; j<vertices[i].size(); j++) {
-//       glm::vec3 vPos = vertices[i][j]->getPos();
-//       fprintf(objfile, "v %.6f %.6f %.6f\n", vPos.x, vPos.y, vPos.z);
-//     }
-//
-//     //create a group
-//     //need to also check that this vector of verices isn't empty
-//     if (vertices[i].size() > 0) {
-//       fprintf(objfile, "g partition%d\n", i);
-//     }
-//
-//     //writing the faces in this object to the file
-//     for (j=indexStart; j<triangles.size(); j++) {
-//       Triangle *t = triangles[j];
-//       if (t->getObjectIndex() == (int)i) {
-//         //this face is part of this object
-//         //need to add 1 to index number because for vertices it starts at 1 not 0
-//         fprintf(objfile, "f %d %d %d\n", (*t)[0]->getIndex()+1, (*t)[1]->getIndex()+1, (*t)[2]->getIndex()+1);
-//       } else {
-//         indexStart = j;
-//         break;
-//       }
-//     }
-//   }
-// }
+bool Mesh::WriteSTL(const std::string &filename) const {
+  STLWriter writer;
+  if (!writer.Open(filename)) {
+    return false;
+  }
+  for (triangleshashtype::const_iterator iter = triangles.begin();
+       iter != triangles.end(); iter++) {
+    Triangle *t = iter->second;
+    const glm::vec3 &a = (*t)[0]->getPos();
+    const glm::vec3 &b = (*t)[1]->getPos();
+    const glm::vec3 &c = (*t)[2]->getPos();
+    writer.AddTriangle(ComputeNormal(a,b,c), a, b, c);
+  }
+  return writer.Close();
+}
+
+// =======================================================================
+// edges as pairs of vertex indices (for CutPreview)
+// =======================================================================
+
+void Mesh::getEdgeEndpoints(std::vector<unsigned int> &ends) const {
+  ends.reserve(ends.size() + edges.size());
+  for (edgeshashtype::const_iterator iter = edges.begin();
+       iter != edges.end(); iter++) {
+    Edge *e = iter->second;
+    int a = e->getStartVertex()->getIndex();
+    int b = e->getEndVertex()->getIndex();
+    // (of a pair of half-edges only the one going up)
+    if (e->getOpposite() != NULL && a > b) continue;
+    ends.push_back(a);
+    ends.push_back(b);
+  }
+}
+
+// =======================================================================
+// triangles as triples of vertex indices (for the thumbnails)
+// =======================================================================
+
+void Mesh::getTriangleCorners(std::vector<unsigned int> &corners) const {
+  corners.reserve(corners.size() + 3 * triangles.size());
+  for (triangleshashtype::const_iterator iter = triangles.begin();
+       iter != triangles.end(); iter++) {
+    Triangle *t = iter->second;
+    for (int j = 0; j < 3; j++) {
+      corners.push_back((*t)[j]->getIndex());
+    }
+  }
+}
+
+// =======================================================================
+// this function outputs the mesh into a very simple .obj file.  Vertices
+// that no triangle uses (e.g. the corners left behind when BSPTree::chop
+// prunes the triangles crossing the cutting plane) are skipped, and the
+// remaining ones are renumbered in the order the triangles use them.
+// =======================================================================
+
+bool Mesh::OutputFile(const std::string &filename) const {
+  FILE *objfile = fopen(filename.c_str(),"w");
+  if (objfile == NULL) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  setvbuf(objfile, NULL, _IOFBF, 1 << 20);
+
+  // compact numbering (obj indices start at 1, 0 = unused)
+  std::vector<int> new_index(numVertices(), 0);
+  std::vector<Vertex*> used;
+  std::vector<Triangle*> tris;
+  tris.reserve(numTriangles());
+  for (triangleshashtype::const_iterator iter = triangles.begin();
+       iter != triangles.end(); iter++) {
+    Triangle *t = iter->second;
+    tris.push_back(t);
+    for (int i = 0; i < 3; i++) {
+      Vertex *v = (*t)[i];
+      if (new_index[v->getIndex()] == 0) {
+        used.push_back(v);
+        new_index[v->getIndex()] = used.size();
+      }
+    }
+  }
+
+  fprintf(objfile, "# %d vertices, %d triangles\n", (int)used.size(), (int)tris.size());
+  for (unsigned int i = 0; i < used.size(); i++) {
+    const glm::vec3 &pos = used[i]->getPos();
+    fprintf(objfile, "v %.6f %.6f %.6f\n", pos.x, pos.y, pos.z);
+  }
+  for (unsigned int i = 0; i < tris.size(); i++) {
+    Triangle *t = tris[i];
+    fprintf(objfile, "f %d %d %d\n",
+            new_index[(*t)[0]->getIndex()],
+            new_index[(*t)[1]->getIndex()],
+            new_index[(*t)[2]->getIndex()]);
+  }
+  bool ok = !ferror(objfile);
+  ok = (fclose(objfile) == 0) && ok;
+  return ok;
+}
 
 // =======================================================================
 
@@ -337,11 +500,12 @@ void Mesh::ComputeGouraudNormals() {
   for (i = 0; i < numVertices(); i++) {
     getVertex(i)->normalizeGouraudNormal();
   }
+  vbo_dirty = true;
 }
 
 // =================================================================
 
-bool Mesh::fitsInVolume(float width, float height, float length) {
+bool Mesh::fitsInVolume(float width, float height, float length) const {
   // sort the dimensions of our working volume into small, medium, and large dimensions
   float dims[] = {width, height, length};
   int smallIndex = 0, largeIndex = 0;
@@ -382,7 +546,12 @@ bool Mesh::fitsInVolume(float width, float height, float length) {
 
 // helper function to calculate the fPart objective function
 // estimates the number of print volumes required to make the current part
-int Mesh::numPrintVolumes(float width, float height, float length) {
+int Mesh::numPrintVolumes(float width, float height, float length) const {
+  return NumPrintVolumes(bbox.getMax() - bbox.getMin(), width, height, length);
+}
+
+// (the same, for a part with bounding box dimensions boundingBoxDimensions)
+int Mesh::NumPrintVolumes(const glm::vec3 &boundingBoxDimensions, float width, float height, float length) {
 
   // sort the dimensions of our working volume into small, medium, and large dimensions
   float dims[] = {width, height, length};
@@ -402,7 +571,6 @@ int Mesh::numPrintVolumes(float width, float height, float length) {
 
   // for now just use axis-aligned bounding box
   // and sort their dimensions just as before
-  glm::vec3 boundingBoxDimensions = bbox.getMax() - bbox.getMin();
   float bdims[] = {boundingBoxDimensions.x, boundingBoxDimensions.y, boundingBoxDimensions.z};
   int bsmallIndex = 0, blargeIndex = 0;
   for (int i = 0; i < 3; ++i) {
@@ -426,7 +594,7 @@ int Mesh::numPrintVolumes(float width, float height, float length) {
   return std::max(std::max(numSmall, numMedium), numLarge);
 }
 
-glm::vec3 Mesh::getBoundingBoxDims() {
+glm::vec3 Mesh::getBoundingBoxDims() const {
   glm::vec3 boundingBoxDimensions = bbox.getMax() - bbox.getMin();
   return boundingBoxDimensions;
 }
@@ -25,32 +25,49 @@ public:
   // CONSTRUCTOR & DESTRUCTOR
   Mesh() {
     args = NULL;
-    float r = (float)(args->rand());
-    float g = (float)(args->rand());
-    float b = (float)(args->rand());
-    meshColor = glm::vec4(r,g,b,1);
+    source_hash = 0;
+    bbox_valid = false;
+    next_triangle_id = 0;
+    mesh_id = NextID();
+    vbo_dirty = true;
+    // (no ArgParser to draw a random colour from)
+    meshColor = glm::vec4(1,1,1,1);
   }
   Mesh(ArgParser *_args) {
     args = _args;
+    source_hash = 0;
+    bbox_valid = false;
+    next_triangle_id = 0;
+    mesh_id = NextID();
+    vbo_dirty = true;
     float r = (float)(args->rand());
     float g = (float)(args->rand());
     float b = (float)(args->rand());
     meshColor = glm::vec4(r,g,b,1);
   }
   Mesh(const Mesh &oldMesh);
+  Mesh(Mesh &&oldMesh);
   ~Mesh();
 
-  // ASSIGNMENT OPERATOR
+  // ASSIGNMENT OPERATORS
   Mesh& operator= (const Mesh& oldMesh);
+  Mesh& operator= (Mesh&& oldMesh);
 
   void clear();
   void Load();
+  // bulk construction of the half-edge structure from flat arrays
+  // (the opposite half-edge table is computed if not provided)
+  void Build(const glm::vec3 *positions, int num_vertices,
+             const unsigned int *indices, int num_triangles,
+             const int *opposites = NULL);
   void ComputeGouraudNormals();
 
-  void initializeVBOs();
-  void setupVBOs();
-  void drawVBOs();
-  void cleanupVBOs();
+  // appends the triangles this mesh is drawn with to verts & indices,
+  // as part number part of the buffer all partitions share, and the
+  // kinds of their edges to edges (see PartitionBuffers)
+  void AppendVBOData(unsigned int part, std::vector<VBOPartVertex> &verts,
+                     std::vector<VBOIndexedTri> &indices,
+                     std::vector<unsigned char> &edges) const;
 
   // ========
   // VERTICES
@@ -79,30 +96,40 @@ public:
   // ===============
   // OTHER ACCESSORS
   const BoundingBox& getBoundingBox() const { return bbox; }
+  // HashBytes of the file the mesh was loaded from (0 if not loaded)
+  unsigned long long getSourceHash() const { return source_hash; }
+  const glm::vec4& getColor() const { return meshColor; }
+
+  // the indices of the end vertices of every edge (each edge once,
+  // 2 per edge)
+  void getEdgeEndpoints(std::vector<unsigned int> &ends) const;
+  // the indices of the corner vertices of every triangle (3 per
+  // triangle)
+  void getTriangleCorners(std::vector<unsigned int> &corners) const;
+
+  // =============
+  // RENDER STATE
+  // unique for every Mesh object (a copy gets a new one)
+  unsigned int getID() const { return mesh_id; }
+  // set by every change of the vertices, triangles or normals, cleared
+  // by whoever rebuilt the VBO data from them (see PartitionBuffers)
+  bool isVBODirty() const { return vbo_dirty; }
+  void setVBOClean() const { vbo_dirty = false; }
   glm::vec3 LightPosition() const;
 
-  // function that helps with doing the wireframe stuff
-  void TriVBOHelper( const glm::vec3 &pos_a,
-                     const glm::vec3 &pos_b,
-                     const glm::vec3 &pos_c,
-                     const glm::vec3 &normal_a,
-                     const glm::vec3 &normal_b,
-                     const glm::vec3 &normal_c,
-                     const glm::vec4 &color_ab,
-                     const glm::vec4 &color_bc,
-                     const glm::vec4 &color_ca,
-                     const glm::vec4 &center_color);
-
-  // function to output scene into obj file
-  void OutputFile();
+  // function to output the mesh into an obj file
+  bool OutputFile(const std::string &filename) const;
+  // writes the mesh as a binary .stl file
+  bool WriteSTL(const std::string &filename) const;
 
   // Determines whether mesh can fit inside of specified volume dimensions
-  bool fitsInVolume(float width, float height, float length);
+  bool fitsInVolume(float width, float height, float length) const;
 
   // HELPER FUNCTIONS FOR OBJECTIVE FUNCTIONS
-  int numPrintVolumes(float width, float height, float length);
-  float getBBVolume() { return bbox.getVolume(); }
-  glm::vec3 getBoundingBoxDims();
+  int numPrintVolumes(float width, float height, float length) const;
+  static int NumPrintVolumes(const glm::vec3 &boundingBoxDimensions, float width, float height, float length);
+  float getBBVolume() const { return bbox.getVolume(); }
+  glm::vec3 getBoundingBoxDims() const;
 
   // ==================================================
   // PARENT VERTEX RELATIONSHIPS (used for subdivision)
@@ -114,10 +141,10 @@ public:
 
 private:
 
-  // HELPER FUNCTIONS FOR PAINT
-  void SetupMesh();
-
-  void DrawMesh();
+  // HELPERS FOR COPY & MOVE
+  void copyGeometry(const Mesh &oldMesh);
+  void takeGeometry(Mesh &oldMesh);
+  static unsigned int NextID();
 
   // ==============
   // REPRESENTATION
@@ -125,17 +152,18 @@ private:
   std::vector<Vertex*> vertices;
   edgeshashtype edges;
   triangleshashtype triangles;
+  // the id of the next triangle added (mesh-local, so meshes can be
+  // built on several threads at once)
+  int next_triangle_id;
   BoundingBox bbox;
+  // false until a vertex has been added to bbox
+  bool bbox_valid;
   glm::vec4 meshColor;  //pre-defined colors for different objects in mesh
   vphashtype vertex_parents;
-
-  // VBOs
-  GLuint mesh_tri_verts_VBO;
-  GLuint mesh_tri_indices_VBO;
-
-  std::vector<VBOPosNormalColor> mesh_tri_verts;
-  std::vector<VBOIndexedTri> mesh_tri_indices;
-
+  unsigned long long source_hash;
+  unsigned int mesh_id;
+  // (render state, not geometry, so it may change on a const mesh)
+  mutable bool vbo_dirty;
 };
 
 // ======================================================================
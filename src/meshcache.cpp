@@ -0,0 +1,112 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "meshcache.h"
+
+static const char mesh_cache_magic[8] = { 'A','C','G','M','E','S','H','\0' };
+
+// ======================================================================
+
+bool MeshCacheFile::Open(const std::string &filename,
+                         unsigned long long source_size, unsigned long long source_hash,
+                         float weld_tolerance) {
+  header = NULL;
+  if (!file.Open(filename)) return false;
+  if (file.size() < sizeof(MeshCacheHeader)) {
+    file.Close();
+    return false;
+  }
+  const MeshCacheHeader *h = (const MeshCacheHeader*)file.data();
+  unsigned long long expected_size = (unsigned long long)h->header_size +
+    sizeof(float) * 3 * (unsigned long long)h->num_vertices +
+    (sizeof(unsigned int) + sizeof(int)) * 3 * (unsigned long long)h->num_triangles;
+  if (memcmp(h->magic, mesh_cache_magic, 8) != 0 ||
+      h->version != MESH_CACHE_VERSION ||
+      h->header_size != sizeof(MeshCacheHeader) ||
+      h->source_size != source_size ||
+      h->source_hash != source_hash ||
+      h->weld_tolerance != weld_tolerance ||
+      expected_size != file.size()) {
+    file.Close();
+    return false;
+  }
+  header = h;
+  if (!ValidArrays()) {
+    std::cout << "WARNING: mesh cache '" << filename << "' is corrupt, ignoring it" << std::endl;
+    header = NULL;
+    file.Close();
+    return false;
+  }
+  return true;
+}
+
+bool MeshCacheFile::ValidArrays() const {
+  int num_vertices = numVertices();
+  int num_half_edges = 3*numTriangles();
+  const unsigned int *idx = indices();
+  const int *opp = opposites();
+  int num_bad = 0;
+  #pragma omp parallel for reduction(+:num_bad)
+  for (int i = 0; i < num_half_edges; i++) {
+    if (idx[i] >= (unsigned int)num_vertices) num_bad++;
+    int j = opp[i];
+    if (j == -1) continue;
+    if (j < 0 || j >= num_half_edges || j == i || opp[j] != i) num_bad++;
+  }
+  return num_bad == 0;
+}
+
+// ======================================================================
+
+bool WriteMeshCache(const std::string &filename,
+                    unsigned long long source_size, unsigned long long source_hash,
+                    float weld_tolerance, const IndexedMesh &mesh, const std::vector<int> &opposites) {
+  assert ((int)opposites.size() == 3*mesh.numTriangles());
+
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, mesh_cache_magic, 8);
+  header.version = MESH_CACHE_VERSION;
+  header.header_size = sizeof(MeshCacheHeader);
+  header.source_size = source_size;
+  header.source_hash = source_hash;
+  header.weld_tolerance = weld_tolerance;
+  header.num_vertices = mesh.numVertices();
+  header.num_triangles = mesh.numTriangles();
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".tmp%d", (int)getpid());
+  std::string temp_file = filename + suffix;
+  FILE *fp = fopen(temp_file.c_str(), "wb");
+  if (fp == NULL) {
+    std::cout << "WARNING: cannot write mesh cache '" << filename << "'" << std::endl;
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  if (mesh.numVertices() > 0) {
+    ok = ok && fwrite(mesh.positions.data(), sizeof(glm::vec3), mesh.numVertices(), fp) == (size_t)mesh.numVertices();
+  }
+  if (mesh.numTriangles() > 0) {
+    ok = ok && fwrite(mesh.indices.data(), sizeof(unsigned int), mesh.indices.size(), fp) == mesh.indices.size();
+    ok = ok && fwrite(opposites.data(), sizeof(int), opposites.size(), fp) == opposites.size();
+  }
+  ok = (fclose(fp) == 0) && ok;
+#if defined(_WIN32)
+  // rename won't replace an existing file on Windows
+  if (ok) remove(filename.c_str());
+#endif
+  if (!ok || rename(temp_file.c_str(), filename.c_str()) != 0) {
+    std::cout << "WARNING: cannot write mesh cache '" << filename << "'" << std::endl;
+    remove(temp_file.c_str());
+    return false;
+  }
+  return true;
+}
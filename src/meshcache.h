@@ -0,0 +1,86 @@
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "meshio.h"
+
+// ======================================================================
+// Binary mesh cache.  Holds everything Mesh::Build needs (positions,
+// triangle indices and the opposite half-edge table), laid out so the
+// arrays can be used straight from a memory mapping.  The header
+// records the size & hash of the source file the cache was made from
+// and the weld tolerance, a cache that doesn't match is ignored.  So is
+// one whose indices or opposites are out of range, which Build would
+// crash on.
+//
+//   MeshCacheHeader
+//   float         positions[3*num_vertices]
+//   unsigned int  indices[3*num_triangles]
+//   int           opposites[3*num_triangles]
+// ======================================================================
+
+#define MESH_CACHE_EXTENSION ".cache"
+#define MESH_CACHE_VERSION 3
+
+struct MeshCacheHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int header_size;
+  unsigned long long source_size;
+  unsigned long long source_hash;
+  // the WeldVertices tolerance the mesh was loaded with (-1 = not welded)
+  float weld_tolerance;
+  unsigned int padding;
+  unsigned int num_vertices;
+  unsigned int num_triangles;
+};
+
+// ======================================================================
+
+class MeshCacheFile {
+
+public:
+
+  MeshCacheFile() { header = NULL; }
+
+  // maps the cache, fails if it is missing, corrupt, from another
+  // version or made from a different source file or weld tolerance
+  bool Open(const std::string &filename,
+            unsigned long long source_size, unsigned long long source_hash,
+            float weld_tolerance);
+
+  // =========
+  // ACCESSORS
+  int numVertices() const { assert (header != NULL); return header->num_vertices; }
+  int numTriangles() const { assert (header != NULL); return header->num_triangles; }
+  const glm::vec3* positions() const {
+    return (const glm::vec3*)(file.data() + header->header_size); }
+  const unsigned int* indices() const {
+    return (const unsigned int*)(positions() + numVertices()); }
+  const int* opposites() const {
+    return (const int*)(indices() + 3*numTriangles()); }
+
+private:
+
+  // every index names a vertex, every opposite is -1 or a half-edge
+  // whose opposite is this one
+  bool ValidArrays() const;
+
+  // ==============
+  // REPRESENTATION
+  MappedFile file;
+  const MeshCacheHeader *header;
+};
+
+// ======================================================================
+
+// writes a new cache file (atomically, through a temporary file and a
+// rename, so concurrent runs never see a partial cache)
+bool WriteMeshCache(const std::string &filename,
+                    unsigned long long source_size, unsigned long long source_hash,
+                    float weld_tolerance, const IndexedMesh &mesh, const std::vector<int> &opposites);
+
+#endif
@@ -0,0 +1,1017 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <unordered_set>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "meshio.h"
+
+// ======================================================================
+// MEMORY MAPPED FILES
+// ======================================================================
+
+// maps all of an open file read-only, ptr & length stay NULL & 0 for
+// an empty file (see MappedFile::Open for sequential)
+#if defined(_WIN32)
+static bool MapFile(HANDLE file, const char *&ptr, size_t &length, void *&handle) {
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) return false;
+  length = (size_t)file_size.QuadPart;
+  if (length > 0) {
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL) {
+      ptr = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      if (ptr == NULL) { CloseHandle(mapping); mapping = NULL; }
+    }
+    if (mapping == NULL) { length = 0; return false; }
+    handle = mapping;
+  }
+  return true;
+}
+#else
+static bool MapFile(int fd, const char *&ptr, size_t &length, bool sequential) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) return false;
+  length = (size_t)st.st_size;
+  if (length > 0) {
+    void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) { length = 0; return false; }
+    // a whole file is parsed in concurrent chunks, so ask for read-ahead
+    // of everything; a streamed one may be larger than RAM
+    madvise(p, length, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+    ptr = (const char*)p;
+  }
+  return true;
+}
+#endif
+
+bool MappedFile::Open(const std::string &filename, bool sequential) {
+  Close();
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return false;
+  opened = MapFile(file, ptr, length, handle);
+  CloseHandle(file);
+  (void)sequential;
+#else
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  opened = MapFile(fd, ptr, length, sequential);
+  ::close(fd);
+#endif
+  return opened;
+}
+
+bool MappedFile::Open(FILE *fp, bool sequential) {
+  Close();
+  if (fflush(fp) != 0) return false;
+#if defined(_WIN32)
+  opened = MapFile((HANDLE)_get_osfhandle(_fileno(fp)), ptr, length, handle);
+  (void)sequential;
+#else
+  opened = MapFile(fileno(fp), ptr, length, sequential);
+#endif
+  return opened;
+}
+
+void MappedFile::Discard(size_t end) {
+#if !defined(_WIN32)
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  end = std::min(end, length) / page * page;
+  if (ptr != NULL && end > 0) {
+    madvise((void*)ptr, end, MADV_DONTNEED);
+  }
+#else
+  (void)end;
+#endif
+}
+
+void MappedFile::Close() {
+  if (ptr != NULL) {
+#if defined(_WIN32)
+    UnmapViewOfFile(ptr);
+    CloseHandle((HANDLE)handle);
+#else
+    munmap((void*)ptr, length);
+#endif
+  }
+  ptr = NULL;
+  length = 0;
+  handle = NULL;
+  opened = false;
+}
+
+std::string FileExtension(const std::string &filename) {
+  size_t dot = filename.find_last_of('.');
+  if (dot == std::string::npos) return "";
+  std::string ext = filename.substr(dot+1);
+  for (unsigned int i = 0; i < ext.size(); ++i) {
+    if (ext[i] >= 'A' && ext[i] <= 'Z') ext[i] = ext[i] - 'A' + 'a';
+  }
+  return ext;
+}
+
+// ======================================================================
+// NUMBER PARSING
+// hand written replacements for sscanf/strtof, they only need to deal
+// with the plain decimal numbers found in mesh files
+// ======================================================================
+
+static const double powers_of_ten[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double ScaleByPowerOfTen(double value, int exponent) {
+  if (exponent < 0) {
+    for (; exponent < -22; exponent += 22) value /= 1e22;
+    return value / powers_of_ten[-exponent];
+  }
+  for (; exponent > 22; exponent -= 22) value *= 1e22;
+  return value * powers_of_ten[exponent];
+}
+
+static inline const char* SkipBlanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+static inline const char* SkipToLineEnd(const char *p, const char *end) {
+  const char *nl = (const char*)memchr(p, '\n', end-p);
+  return (nl == NULL) ? end : nl;
+}
+
+static inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// returns NULL if there is no number at p
+static const char* ParseFloat(const char *p, const char *end, float &value) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) { negative = (*p == '-'); p++; }
+  unsigned long long mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  // only the first 19 significant digits fit, the rest just scale
+  for (; p < end && IsDigit(*p); ++p, ++digits) {
+    if (mantissa < 1000000000000000000ULL) mantissa = mantissa * 10 + (*p - '0');
+    else exponent++;
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && IsDigit(*p); ++p, ++digits) {
+      if (mantissa < 1000000000000000000ULL) { mantissa = mantissa * 10 + (*p - '0'); exponent--; }
+    }
+  }
+  if (digits == 0) return NULL;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p+1;
+    bool negative_exponent = false;
+    if (q < end && (*q == '-' || *q == '+')) { negative_exponent = (*q == '-'); q++; }
+    if (q < end && IsDigit(*q)) {
+      int e = 0;
+      for (; q < end && IsDigit(*q); ++q) { if (e < 10000) e = e * 10 + (*q - '0'); }
+      exponent += negative_exponent ? -e : e;
+      p = q;
+    }
+  }
+  double v = ScaleByPowerOfTen((double)mantissa, exponent);
+  value = (float)(negative ? -v : v);
+  return p;
+}
+
+// returns NULL if there is no number at p
+static const char* ParseInt(const char *p, const char *end, long long &value) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) { negative = (*p == '-'); p++; }
+  if (p >= end || !IsDigit(*p)) return NULL;
+  long long v = 0;
+  for (; p < end && IsDigit(*p); ++p) {
+    if (v < (1LL << 40)) v = v * 10 + (*p - '0');
+  }
+  value = negative ? -v : v;
+  return p;
+}
+
+// ======================================================================
+// OBJ PARSING
+// ======================================================================
+
+// Face corners that use relative (negative) indices can refer to
+// vertices of an earlier chunk, so they are stored relative to the
+// start of their chunk (biased by this constant) and fixed up once the
+// vertex counts of all chunks are known.
+static const long long RELATIVE_INDEX_BIAS = 1LL << 48;
+
+struct OBJChunk {
+  const char *begin;
+  const char *end;
+  std::vector<glm::vec3> positions;
+  std::vector<long long> corners;
+  std::string error;
+};
+
+static void ParseOBJChunk(OBJChunk &chunk) {
+  const char *p = chunk.begin;
+  const char *end = chunk.end;
+  std::vector<long long> polygon;
+  while (p < end) {
+    p = SkipBlanks(p, end);
+    const char *line_end = SkipToLineEnd(p, end);
+    if (p == line_end) { p = line_end + 1; continue; }
+    // (a comment may follow the data on the line)
+    const char *data_end = (const char*)memchr(p, '#', line_end - p);
+    if (data_end == NULL) data_end = line_end;
+
+    if (p[0] == 'v' && p+1 < data_end && (p[1] == ' ' || p[1] == '\t')) {
+      // vertex position
+      glm::vec3 pos;
+      const char *q = p+1;
+      for (int i = 0; i < 3; ++i) {
+        q = SkipBlanks(q, data_end);
+        q = ParseFloat(q, data_end, pos[i]);
+        if (q == NULL) break;
+      }
+      if (q == NULL) {
+        chunk.error = "bad vertex '" + std::string(p, line_end) + "'";
+        return;
+      }
+      chunk.positions.push_back(pos);
+    } else if (p[0] == 'f' && p+1 < data_end && (p[1] == ' ' || p[1] == '\t')) {
+      // face, each corner is "v", "v/vt", "v//vn" or "v/vt/vn"
+      polygon.clear();
+      const char *q = SkipBlanks(p+1, data_end);
+      while (q < data_end) {
+        long long index;
+        const char *r = ParseInt(q, data_end, index);
+        if (r == NULL || index == 0) {
+          chunk.error = "bad face '" + std::string(p, line_end) + "'";
+          return;
+        }
+        if (index > 0) {
+          polygon.push_back(index - 1);
+        } else {
+          polygon.push_back(RELATIVE_INDEX_BIAS + (long long)chunk.positions.size() + index);
+        }
+        // skip the texture coordinate & normal indices
+        while (r < data_end && *r != ' ' && *r != '\t' && *r != '\r') r++;
+        q = SkipBlanks(r, data_end);
+      }
+      if (polygon.size() < 3) {
+        chunk.error = "bad face '" + std::string(p, line_end) + "'";
+        return;
+      }
+      // triangulate as a fan
+      for (unsigned int i = 2; i < polygon.size(); ++i) {
+        chunk.corners.push_back(polygon[0]);
+        chunk.corners.push_back(polygon[i-1]);
+        chunk.corners.push_back(polygon[i]);
+      }
+    }
+    // everything else (vt, vn, g, usemtl, s, comments, ...) is ignored
+    p = line_end + 1;
+  }
+}
+
+// splits the text into chunks that end on line boundaries & parses
+// them in parallel
+static void ParseOBJChunks(const char *text, const char *end, std::vector<OBJChunk> &chunks) {
+  int num_threads = 1;
+#ifdef _OPENMP
+  num_threads = omp_get_max_threads();
+#endif
+  size_t chunk_size = std::max((size_t)(1 << 16), (size_t)(end - text) / (4 * num_threads) + 1);
+  for (const char *p = text; p < end; ) {
+    const char *chunk_end = p + std::min(chunk_size, (size_t)(end - p));
+    chunk_end = SkipToLineEnd(chunk_end, end);
+    if (chunk_end < end) chunk_end++;
+    chunks.push_back(OBJChunk());
+    chunks.back().begin = p;
+    chunks.back().end = chunk_end;
+    p = chunk_end;
+  }
+  int num_chunks = chunks.size();
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < num_chunks; ++i) {
+    ParseOBJChunk(chunks[i]);
+  }
+}
+
+bool ParseOBJ(const char *text, size_t size, IndexedMesh &result) {
+  result.clear();
+
+  std::vector<OBJChunk> chunks;
+  ParseOBJChunks(text, text + size, chunks);
+  int num_chunks = chunks.size();
+
+  // prefix sums give each chunk its place in the merged arrays
+  std::vector<size_t> vertex_offsets(num_chunks+1, 0);
+  std::vector<size_t> corner_offsets(num_chunks+1, 0);
+  for (int i = 0; i < num_chunks; ++i) {
+    if (chunks[i].error != "") {
+      std::cout << "ERROR! OBJ PARSE: " << chunks[i].error << std::endl;
+      return false;
+    }
+    vertex_offsets[i+1] = vertex_offsets[i] + chunks[i].positions.size();
+    corner_offsets[i+1] = corner_offsets[i] + chunks[i].corners.size();
+  }
+  long long num_vertices = vertex_offsets[num_chunks];
+  result.positions.resize(num_vertices);
+  result.indices.resize(corner_offsets[num_chunks]);
+
+  int bad_corners = 0;
+  #pragma omp parallel for schedule(dynamic) reduction(+:bad_corners)
+  for (int i = 0; i < num_chunks; ++i) {
+    const OBJChunk &chunk = chunks[i];
+    std::copy(chunk.positions.begin(), chunk.positions.end(),
+              result.positions.begin() + vertex_offsets[i]);
+    for (size_t j = 0; j < chunk.corners.size(); ++j) {
+      long long index = chunk.corners[j];
+      if (index >= RELATIVE_INDEX_BIAS / 2) {
+        index = index - RELATIVE_INDEX_BIAS + (long long)vertex_offsets[i];
+      }
+      if (index < 0 || index >= num_vertices) {
+        bad_corners++;
+        index = 0;
+      }
+      result.indices[corner_offsets[i] + j] = (unsigned int)index;
+    }
+  }
+  if (bad_corners > 0) {
+    std::cout << "ERROR! OBJ PARSE: " << bad_corners << " face indices out of range" << std::endl;
+    result.clear();
+    return false;
+  }
+  return true;
+}
+
+bool LoadOBJ(const std::string &filename, IndexedMesh &result) {
+  MappedFile file;
+  if (!file.Open(filename)) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  return ParseOBJ(file.data(), file.size(), result);
+}
+
+// ======================================================================
+// STL PARSING
+// ======================================================================
+
+#define STL_HEADER_SIZE 80
+#define STL_RECORD_SIZE 50
+
+static bool ParseBinarySTL(const char *data, size_t size, IndexedMesh &result) {
+  if (size < STL_HEADER_SIZE + 4) {
+    std::cout << "ERROR! STL PARSE: truncated file" << std::endl;
+    return false;
+  }
+  unsigned int num_triangles;
+  memcpy(&num_triangles, data + STL_HEADER_SIZE, 4);
+  // (never read past the end of a truncated file)
+  if ((size - STL_HEADER_SIZE - 4) / STL_RECORD_SIZE < (size_t)num_triangles) {
+    std::cout << "ERROR! STL PARSE: " << num_triangles << " triangles don't fit in the file" << std::endl;
+    return false;
+  }
+  result.positions.resize(3*(size_t)num_triangles);
+  result.indices.resize(3*(size_t)num_triangles);
+  const char *records = data + STL_HEADER_SIZE + 4;
+  #pragma omp parallel for
+  for (int i = 0; i < (int)num_triangles; i++) {
+    // each record: normal, 3 corners (all float[3]), 2 byte attribute
+    const char *r = records + (size_t)i * STL_RECORD_SIZE;
+    memcpy(&result.positions[3*i], r + 12, 36);
+    result.indices[3*i] = 3*i;
+    result.indices[3*i+1] = 3*i+1;
+    result.indices[3*i+2] = 3*i+2;
+  }
+  return true;
+}
+
+// appends the corners ("vertex x y z" records) found in the text
+static bool ParseASCIISTLCorners(const char *p, const char *end, std::vector<glm::vec3> &corners) {
+  while (p < end) {
+    p = SkipBlanks(p, end);
+    const char *line_end = SkipToLineEnd(p, end);
+    // the only records we need are the corners, "vertex x y z"
+    if (line_end - p > 6 && strncmp(p, "vertex", 6) == 0) {
+      glm::vec3 pos;
+      const char *q = p+6;
+      for (int i = 0; i < 3 && q != NULL; ++i) {
+        q = SkipBlanks(q, line_end);
+        q = ParseFloat(q, line_end, pos[i]);
+      }
+      if (q == NULL) {
+        std::cout << "ERROR! STL PARSE: bad vertex '" << std::string(p, line_end) << "'" << std::endl;
+        return false;
+      }
+      corners.push_back(pos);
+    }
+    p = line_end + 1;
+  }
+  return true;
+}
+
+static bool ParseASCIISTL(const char *data, size_t size, IndexedMesh &result) {
+  if (!ParseASCIISTLCorners(data, data + size, result.positions)) {
+    result.clear();
+    return false;
+  }
+  if (result.positions.size() % 3 != 0) {
+    std::cout << "ERROR! STL PARSE: incomplete facet" << std::endl;
+    result.clear();
+    return false;
+  }
+  result.indices.resize(result.positions.size());
+  for (unsigned int i = 0; i < result.indices.size(); i++) {
+    result.indices[i] = i;
+  }
+  return true;
+}
+
+// binary files may also start with "solid", so go by the size first
+static bool IsBinarySTL(const char *data, size_t size) {
+  if (size < STL_HEADER_SIZE + 4) return false;
+  unsigned int num_triangles;
+  memcpy(&num_triangles, data + STL_HEADER_SIZE, 4);
+  return size == STL_HEADER_SIZE + 4 + (size_t)num_triangles * STL_RECORD_SIZE;
+}
+
+bool ParseSTL(const char *data, size_t size, IndexedMesh &result) {
+  result.clear();
+  bool ok;
+  if (IsBinarySTL(data, size)) {
+    ok = ParseBinarySTL(data, size, result);
+  } else if (size >= 5 && strncmp(data, "solid", 5) == 0) {
+    ok = ParseASCIISTL(data, size, result);
+  } else {
+    std::cout << "ERROR! STL PARSE: not a binary or ASCII stl file" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+bool ParseMeshFile(const std::string &filename, const char *data, size_t size,
+                   IndexedMesh &result) {
+  if (FileExtension(filename) == "stl") {
+    return ParseSTL(data, size, result);
+  }
+  return ParseOBJ(data, size, result);
+}
+
+// ======================================================================
+// STREAMING INPUT
+// ======================================================================
+
+// the end of the next block of text, on a line boundary
+static const char* ChunkEnd(const char *p, const char *end, size_t chunk_bytes) {
+  const char *chunk_end = p + std::min(std::max(chunk_bytes, (size_t)1), (size_t)(end - p));
+  chunk_end = SkipToLineEnd(chunk_end, end);
+  if (chunk_end < end) chunk_end++;
+  return chunk_end;
+}
+
+// text read at a time by the first pass over a streamed .obj file
+#define OBJ_POSITIONS_PASS_BYTES (64 << 20)
+
+bool TriangleStream::Open(const std::string &filename) {
+  Close();
+  if (!file.Open(filename, true)) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  position = 0;
+  error = false;
+  pending.clear();
+  binary_stl = ascii_stl = false;
+  if (FileExtension(filename) == "stl") {
+    binary_stl = IsBinarySTL(file.data(), file.size());
+    ascii_stl = !binary_stl;
+    if (binary_stl) position = STL_HEADER_SIZE + 4;
+  } else if (!WriteOBJPositions()) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void TriangleStream::Close() {
+  obj_positions.Close();
+  if (obj_positions_file != NULL) {
+    // (a tmpfile is deleted when it's closed)
+    fclose(obj_positions_file);
+    obj_positions_file = NULL;
+  }
+  num_obj_vertices = 0;
+  file.Close();
+}
+
+bool TriangleStream::WriteOBJPositions() {
+  obj_positions_file = tmpfile();
+  if (obj_positions_file == NULL) {
+    std::cout << "ERROR! CANNOT CREATE A TEMPORARY FILE FOR THE OBJ VERTICES" << std::endl;
+    return false;
+  }
+  const char *p = file.data();
+  const char *end = file.data() + file.size();
+  while (p < end) {
+    const char *chunk_end = ChunkEnd(p, end, OBJ_POSITIONS_PASS_BYTES);
+    std::vector<OBJChunk> chunks;
+    ParseOBJChunks(p, chunk_end, chunks);
+    for (unsigned int i = 0; i < chunks.size(); ++i) {
+      const std::vector<glm::vec3> &positions = chunks[i].positions;
+      if (chunks[i].error != "") {
+        std::cout << "ERROR! OBJ PARSE: " << chunks[i].error << std::endl;
+        return false;
+      }
+      if (positions.size() > 0 &&
+          fwrite(positions.data(), sizeof(glm::vec3), positions.size(), obj_positions_file)
+          != positions.size()) {
+        std::cout << "ERROR! CANNOT WRITE THE TEMPORARY FILE FOR THE OBJ VERTICES" << std::endl;
+        return false;
+      }
+    }
+    p = chunk_end;
+    file.Discard(p - file.data());
+  }
+  if (!obj_positions.Open(obj_positions_file, true)) {
+    std::cout << "ERROR! CANNOT MAP THE TEMPORARY FILE FOR THE OBJ VERTICES" << std::endl;
+    return false;
+  }
+  num_obj_vertices = 0;
+  return true;
+}
+
+bool TriangleStream::ReadChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners) {
+  corners.clear();
+  if (error || position >= file.size()) return false;
+  // the pages behind us won't be touched again
+  file.Discard(position);
+  bool ok;
+  if (binary_stl) {
+    ok = ReadBinarySTLChunk(chunk_bytes, corners);
+  } else if (ascii_stl) {
+    ok = ReadASCIISTLChunk(chunk_bytes, corners);
+  } else {
+    ok = ReadOBJChunk(chunk_bytes, corners);
+  }
+  if (!ok) {
+    error = true;
+    corners.clear();
+  }
+  return ok;
+}
+
+bool TriangleStream::ReadOBJChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners) {
+  const char *begin = file.data() + position;
+  const char *end = ChunkEnd(begin, file.data() + file.size(), chunk_bytes);
+  position = end - file.data();
+  std::vector<OBJChunk> chunks;
+  ParseOBJChunks(begin, end, chunks);
+  for (unsigned int i = 0; i < chunks.size(); ++i) {
+    const OBJChunk &chunk = chunks[i];
+    if (chunk.error != "") {
+      std::cout << "ERROR! OBJ PARSE: " << chunk.error << std::endl;
+      return false;
+    }
+    const glm::vec3 *positions = (const glm::vec3*)obj_positions.data();
+    long long vertex_offset = num_obj_vertices;
+    num_obj_vertices += chunk.positions.size();
+    long long num_vertices = num_obj_vertices;
+    for (size_t j = 0; j < chunk.corners.size(); ++j) {
+      long long index = chunk.corners[j];
+      if (index >= RELATIVE_INDEX_BIAS / 2) {
+        index = index - RELATIVE_INDEX_BIAS + vertex_offset;
+      }
+      // (a streamed face can only use vertices that came before it)
+      if (index < 0 || index >= num_vertices) {
+        std::cout << "ERROR! OBJ PARSE: face index out of range" << std::endl;
+        return false;
+      }
+      corners.push_back(positions[index]);
+    }
+  }
+  return true;
+}
+
+bool TriangleStream::ReadBinarySTLChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners) {
+  size_t num_records = std::max((size_t)1, chunk_bytes / STL_RECORD_SIZE);
+  num_records = std::min(num_records, (file.size() - position) / STL_RECORD_SIZE);
+  corners.resize(3*num_records);
+  const char *records = file.data() + position;
+  #pragma omp parallel for
+  for (int i = 0; i < (int)num_records; i++) {
+    memcpy(&corners[3*i], records + (size_t)i * STL_RECORD_SIZE + 12, 36);
+  }
+  position += num_records * STL_RECORD_SIZE;
+  if (num_records == 0) position = file.size();
+  return true;
+}
+
+bool TriangleStream::ReadASCIISTLChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners) {
+  const char *begin = file.data() + position;
+  const char *end = ChunkEnd(begin, file.data() + file.size(), chunk_bytes);
+  position = end - file.data();
+  if (!ParseASCIISTLCorners(begin, end, pending)) {
+    return false;
+  }
+  // hand out whole facets, keep the rest for the next chunk
+  size_t complete = pending.size() / 3 * 3;
+  if (position >= file.size() && complete != pending.size()) {
+    std::cout << "ERROR! STL PARSE: incomplete facet" << std::endl;
+    return false;
+  }
+  corners.assign(pending.begin(), pending.begin() + complete);
+  pending.erase(pending.begin(), pending.begin() + complete);
+  return true;
+}
+
+// ======================================================================
+// STL OUTPUT
+// ======================================================================
+
+#define STL_WRITE_BUFFER_SIZE (STL_RECORD_SIZE * 20000)
+
+STLWriter::STLWriter() {
+  fp = NULL;
+  used = 0;
+  num_triangles = 0;
+  ok = false;
+}
+
+bool STLWriter::Open(const std::string &filename) {
+  Close();
+  fp = fopen(filename.c_str(), "wb");
+  if (fp == NULL) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  buffer.resize(STL_WRITE_BUFFER_SIZE);
+  used = 0;
+  num_triangles = 0;
+  // header text & a placeholder for the triangle count
+  char header[STL_HEADER_SIZE + 4];
+  memset(header, 0, sizeof(header));
+  strncpy(header, "binary stl", STL_HEADER_SIZE);
+  ok = fwrite(header, sizeof(header), 1, fp) == 1;
+  return ok;
+}
+
+void STLWriter::AddTriangle(const glm::vec3 &normal,
+                            const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+  assert (fp != NULL);
+  if (used + STL_RECORD_SIZE > buffer.size()) Flush();
+  char *r = &buffer[used];
+  memcpy(r,      &normal[0], 12);
+  memcpy(r + 12, &a[0], 12);
+  memcpy(r + 24, &b[0], 12);
+  memcpy(r + 36, &c[0], 12);
+  r[48] = r[49] = 0;
+  used += STL_RECORD_SIZE;
+  num_triangles++;
+}
+
+void STLWriter::Flush() {
+  if (used > 0) {
+    ok = ok && fwrite(&buffer[0], 1, used, fp) == used;
+  }
+  used = 0;
+}
+
+bool STLWriter::Close() {
+  if (fp == NULL) return ok;
+  Flush();
+  ok = ok && fseek(fp, STL_HEADER_SIZE, SEEK_SET) == 0;
+  ok = ok && fwrite(&num_triangles, 4, 1, fp) == 1;
+  ok = (fclose(fp) == 0) && ok;
+  fp = NULL;
+  return ok;
+}
+
+// ======================================================================
+// VERTEX WELDING
+// ======================================================================
+
+// the grid cell a position snaps to (with tolerance 0 the "cell" is
+// just the bit pattern of the coordinates)
+struct WeldCell {
+  long long c[3];
+  bool operator==(const WeldCell &other) const {
+    return c[0] == other.c[0] && c[1] == other.c[1] && c[2] == other.c[2];
+  }
+  bool operator<(const WeldCell &other) const {
+    if (c[0] != other.c[0]) return c[0] < other.c[0];
+    if (c[1] != other.c[1]) return c[1] < other.c[1];
+    return c[2] < other.c[2];
+  }
+};
+
+static WeldCell SnapToCell(const glm::vec3 &p, float tolerance) {
+  WeldCell cell;
+  for (int i = 0; i < 3; i++) {
+    if (tolerance > 0) {
+      cell.c[i] = (long long)floor(p[i] / tolerance + 0.5);
+    } else {
+      float f = p[i];
+      // treat -0 and 0 as the same position
+      if (f == 0) f = 0;
+      int bits;
+      memcpy(&bits, &f, 4);
+      cell.c[i] = bits;
+    }
+  }
+  return cell;
+}
+
+static unsigned long long CellHash(const WeldCell &cell) {
+  unsigned long long h = ((unsigned long long)cell.c[0] * 73856093ULL) ^
+    ((unsigned long long)cell.c[1] * 19349663ULL) ^
+    ((unsigned long long)cell.c[2] * 83492791ULL);
+  return h ^ (h >> 31);
+}
+
+// a triangle rotated so its smallest index comes first (keeps the winding)
+struct TriangleKey {
+  unsigned int v[3];
+  int index;
+  bool operator<(const TriangleKey &other) const {
+    if (v[0] != other.v[0]) return v[0] < other.v[0];
+    if (v[1] != other.v[1]) return v[1] < other.v[1];
+    if (v[2] != other.v[2]) return v[2] < other.v[2];
+    return index < other.index;
+  }
+  bool sameTriangle(const TriangleKey &other) const {
+    return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2];
+  }
+};
+
+int WeldVertices(IndexedMesh &mesh, float tolerance) {
+  int num_vertices = mesh.numVertices();
+  int num_triangles = mesh.numTriangles();
+  if (num_vertices == 0) return 0;
+
+  // snap every vertex to its cell & scatter the vertices into buckets by
+  // cell hash, so that each bucket can be merged independently
+  int num_buckets = std::max(1, num_vertices / 64);
+  std::vector<WeldCell> cells(num_vertices);
+  std::vector<int> bucket(num_vertices);
+  #pragma omp parallel for
+  for (int i = 0; i < num_vertices; i++) {
+    cells[i] = SnapToCell(mesh.positions[i], tolerance);
+    bucket[i] = CellHash(cells[i]) % num_buckets;
+  }
+  std::vector<int> bucket_start(num_buckets+1, 0);
+  for (int i = 0; i < num_vertices; i++) {
+    bucket_start[bucket[i]+1]++;
+  }
+  for (int b = 0; b < num_buckets; b++) {
+    bucket_start[b+1] += bucket_start[b];
+  }
+  std::vector<int> members(num_vertices);
+  {
+    std::vector<int> next(bucket_start.begin(), bucket_start.end()-1);
+    for (int i = 0; i < num_vertices; i++) {
+      members[next[bucket[i]]++] = i;
+    }
+  }
+
+  // inside a bucket, the vertices of a cell are next to each other,
+  // lowest numbered first
+  std::vector<int> remap(num_vertices);
+  #pragma omp parallel for schedule(dynamic,64)
+  for (int b = 0; b < num_buckets; b++) {
+    std::sort(members.data() + bucket_start[b], members.data() + bucket_start[b+1],
+              [&cells](int x, int y) {
+                if (cells[x] == cells[y]) return x < y;
+                return cells[x] < cells[y]; });
+  }
+
+  if (tolerance == 0) {
+    // only identical positions: every vertex maps to the first one of
+    // its cell
+    #pragma omp parallel for schedule(dynamic,64)
+    for (int b = 0; b < num_buckets; b++) {
+      int *first = members.data() + bucket_start[b];
+      int *last = members.data() + bucket_start[b+1];
+      for (int *p = first; p < last; ) {
+        int *q = p + 1;
+        while (q < last && cells[*q] == cells[*p]) {
+          remap[*q] = *p;
+          q++;
+        }
+        remap[*p] = *p;
+        p = q;
+      }
+    }
+  } else {
+    // Vertices closer than the tolerance may have snapped to neighboring
+    // cells.  Cell by cell, each vertex is merged into the lowest
+    // numbered representative within tolerance of it in its own or the 26
+    // neighboring cells, or else becomes a representative itself.  So
+    // every vertex ends up within tolerance of the one it's merged into
+    // (merges don't chain).  This depends on the vertices merged before,
+    // so it runs on one thread.
+    // (a copy of the cells in bucket order keeps the searches cache friendly)
+    std::vector<WeldCell> sorted_cells(num_vertices);
+    #pragma omp parallel for
+    for (int k = 0; k < num_vertices; k++) {
+      sorted_cells[k] = cells[members[k]];
+    }
+    std::vector<char> representative(num_vertices, 0);
+    // the ranges of members of the cells around the current one
+    std::vector<std::pair<int,int> > around;
+    for (int k = 0; k < num_vertices; ) {
+      int cell_end = k + 1;
+      while (cell_end < num_vertices && sorted_cells[cell_end] == sorted_cells[k]) cell_end++;
+      around.clear();
+      for (int n = 0; n < 27; n++) {
+        WeldCell neighbor = sorted_cells[k];
+        neighbor.c[0] += n%3 - 1;
+        neighbor.c[1] += (n/3)%3 - 1;
+        neighbor.c[2] += n/9 - 1;
+        int b = CellHash(neighbor) % num_buckets;
+        const WeldCell *first = sorted_cells.data() + bucket_start[b];
+        const WeldCell *last = sorted_cells.data() + bucket_start[b+1];
+        std::pair<const WeldCell*, const WeldCell*> range = std::equal_range(first, last, neighbor);
+        if (range.first == range.second) continue;
+        around.push_back(std::make_pair(range.first - sorted_cells.data(),
+                                        range.second - sorted_cells.data()));
+      }
+      for (int m = k; m < cell_end; m++) {
+        int i = members[m];
+        int target = -1;
+        for (unsigned int r = 0; r < around.size(); r++) {
+          for (int a = around[r].first; a < around[r].second; a++) {
+            int j = members[a];
+            if (!representative[j] || (target >= 0 && j >= target)) continue;
+            if (glm::length(mesh.positions[i] - mesh.positions[j]) <= tolerance) target = j;
+          }
+        }
+        if (target < 0) {
+          representative[i] = 1;
+          target = i;
+        }
+        remap[i] = target;
+      }
+      k = cell_end;
+    }
+  }
+
+  // renumber the surviving vertices
+  std::vector<unsigned int> new_index(num_vertices);
+  std::vector<glm::vec3> positions;
+  positions.reserve(num_vertices);
+  for (int i = 0; i < num_vertices; i++) {
+    if (remap[i] == i) {
+      new_index[i] = positions.size();
+      positions.push_back(mesh.positions[i]);
+    }
+  }
+  int num_merged = num_vertices - (int)positions.size();
+  if (num_merged == 0) return 0;
+
+  // remap the triangles, then drop the ones that collapsed and the
+  // copies of a triangle that now use the same 3 vertices
+  std::vector<TriangleKey> keys(num_triangles);
+  #pragma omp parallel for
+  for (int t = 0; t < num_triangles; t++) {
+    unsigned int v[3];
+    for (int i = 0; i < 3; i++) {
+      v[i] = new_index[remap[mesh.indices[3*t+i]]];
+    }
+    int r = 0;
+    if (v[1] < v[r]) r = 1;
+    if (v[2] < v[r]) r = 2;
+    for (int i = 0; i < 3; i++) {
+      keys[t].v[i] = v[(r+i)%3];
+    }
+    keys[t].index = (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) ? -1 : t;
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<bool> keep(num_triangles, false);
+  for (int t = 0; t < num_triangles; t++) {
+    if (keys[t].index == -1) continue;
+    if (t > 0 && keys[t-1].index != -1 && keys[t].sameTriangle(keys[t-1])) continue;
+    keep[keys[t].index] = true;
+  }
+  std::vector<unsigned int> indices;
+  indices.reserve(mesh.indices.size());
+  for (int t = 0; t < num_triangles; t++) {
+    if (!keep[t]) continue;
+    for (int i = 0; i < 3; i++) {
+      indices.push_back(new_index[remap[mesh.indices[3*t+i]]]);
+    }
+  }
+  mesh.positions.swap(positions);
+  mesh.indices.swap(indices);
+  return num_merged;
+}
+
+// the directed edge starting at corner i (3*triangle + corner)
+static unsigned long long DirectedEdgeKey(const std::vector<unsigned int> &indices, int i) {
+  unsigned long long s = indices[i];
+  unsigned long long e = indices[(i%3 == 2) ? i-2 : i+1];
+  return (s << 32) | e;
+}
+
+int UnweldDuplicateEdges(IndexedMesh &mesh) {
+  int num_triangles = mesh.numTriangles();
+  int num_half_edges = 3*num_triangles;
+  // (most meshes have no repeated directed edge, sorting finds out fast)
+  std::vector<unsigned long long> keys(num_half_edges);
+  #pragma omp parallel for
+  for (int i = 0; i < num_half_edges; i++) {
+    keys[i] = DirectedEdgeKey(mesh.indices, i);
+  }
+  std::sort(keys.begin(), keys.end());
+  if (std::adjacent_find(keys.begin(), keys.end()) == keys.end()) return 0;
+
+  // in file order, a triangle keeps its vertices unless one of its
+  // directed edges is already taken
+  std::unordered_set<unsigned long long> taken;
+  taken.reserve(num_half_edges);
+  int num_unwelded = 0;
+  for (int t = 0; t < num_triangles; t++) {
+    bool clash = false;
+    for (int i = 0; i < 3; i++) {
+      if (taken.count(DirectedEdgeKey(mesh.indices, 3*t+i))) clash = true;
+    }
+    if (!clash) {
+      for (int i = 0; i < 3; i++) {
+        taken.insert(DirectedEdgeKey(mesh.indices, 3*t+i));
+      }
+      continue;
+    }
+    for (int i = 0; i < 3; i++) {
+      glm::vec3 position = mesh.positions[mesh.indices[3*t+i]];
+      mesh.indices[3*t+i] = mesh.positions.size();
+      mesh.positions.push_back(position);
+    }
+    num_unwelded++;
+  }
+  return num_unwelded;
+}
+
+// ======================================================================
+// HELPERS
+// ======================================================================
+
+void ComputeOpposites(const unsigned int *indices, int num_triangles,
+                      std::vector<int> &opposites) {
+  int num_half_edges = 3*num_triangles;
+  opposites.assign(num_half_edges, -1);
+  // sort the half-edges by their (smaller index, larger index) key, so
+  // that the two halves of each edge end up next to each other
+  std::vector<std::pair<unsigned long long,int> > keys(num_half_edges);
+  for (int i = 0; i < num_half_edges; i++) {
+    unsigned long long s = indices[i];
+    unsigned long long e = indices[(i%3 == 2) ? i-2 : i+1];
+    keys[i] = std::make_pair((std::min(s,e) << 32) | std::max(s,e), i);
+  }
+  std::sort(keys.begin(), keys.end());
+  for (int i = 0; i + 1 < num_half_edges; i++) {
+    if (keys[i].first != keys[i+1].first) continue;
+    int h1 = keys[i].second;
+    int h2 = keys[i+1].second;
+    // only pair half-edges running in opposite directions (a non-manifold
+    // edge may be shared by more than two triangles)
+    if (opposites[h1] == -1 && opposites[h2] == -1 && indices[h1] != indices[h2]) {
+      opposites[h1] = h2;
+      opposites[h2] = h1;
+      i++;
+    }
+  }
+}
+
+unsigned long long HashBytes(const void *data, size_t size, unsigned long long seed) {
+  const unsigned long long multiplier = 0x9E3779B97F4A7C15ULL;
+  const unsigned char *p = (const unsigned char*)data;
+  unsigned long long h = seed ^ (size * multiplier);
+  size_t num_words = size / 8;
+  for (size_t i = 0; i < num_words; i++) {
+    unsigned long long word;
+    memcpy(&word, p + 8*i, 8);
+    h = (h ^ word) * multiplier;
+    h ^= h >> 29;
+  }
+  for (size_t i = 8*num_words; i < size; i++) {
+    h = (h ^ p[i]) * multiplier;
+    h ^= h >> 29;
+  }
+  return h;
+}
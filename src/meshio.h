@@ -0,0 +1,237 @@
+#ifndef _MESH_IO_H_
+#define _MESH_IO_H_
+
+#include <cassert>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// ======================================================================
+// Read-only view of an entire file.  On POSIX & Windows the file is
+// memory mapped, so parsing works directly on the page cache without
+// an extra copy into a user buffer.
+// ======================================================================
+
+class MappedFile {
+
+public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  MappedFile() { ptr = NULL; length = 0; handle = NULL; opened = false; }
+  ~MappedFile() { Close(); }
+
+  // sequential: the file is streamed through a part at a time, so the
+  // OS reads ahead as it's used instead of all of it up front
+  bool Open(const std::string &filename, bool sequential = false);
+  // maps what has been written to fp (which stays open, the caller
+  // closes it after Close())
+  bool Open(FILE *fp, bool sequential = false);
+  void Close();
+  // tells the OS that the first "end" bytes won't be needed again, so
+  // their pages can be dropped (streaming through files larger than RAM)
+  void Discard(size_t end);
+
+  // =========
+  // ACCESSORS
+  const char* data() const { return ptr; }
+  size_t size() const { return length; }
+  bool isOpen() const { return opened; }
+
+private:
+
+  MappedFile(const MappedFile&) { assert(0); }
+  MappedFile& operator=(const MappedFile&) { assert(0); exit(0); }
+
+  // ==============
+  // REPRESENTATION
+  const char *ptr;
+  size_t length;
+  // platform specific mapping handle (unused on POSIX)
+  void *handle;
+  bool opened;
+};
+
+// ======================================================================
+// Flat arrays of vertex positions & triangle corner indices.  This is
+// the intermediate form produced by the file loaders, the half-edge
+// Mesh is built from it in one bulk pass (see Mesh::Build).
+// ======================================================================
+
+struct IndexedMesh {
+  std::vector<glm::vec3> positions;
+  // 3 vertex indices (0-based) per triangle
+  std::vector<unsigned int> indices;
+
+  int numVertices() const { return positions.size(); }
+  int numTriangles() const { return indices.size() / 3; }
+  void clear() { positions.clear(); indices.clear(); }
+};
+
+// ======================================================================
+// OBJ PARSING
+// Understands "v" and "f" records; texture coordinates & normals in
+// faces ("f 1/2/3 ...", "f 1//3 ...") are skipped, negative (relative)
+// indices are resolved and polygons are triangulated as a fan.  All
+// other records are ignored.  The text is split into chunks on line
+// boundaries and the chunks are parsed in parallel.
+// ======================================================================
+
+bool ParseOBJ(const char *text, size_t size, IndexedMesh &result);
+bool LoadOBJ(const std::string &filename, IndexedMesh &result);
+
+// ======================================================================
+// HELPERS
+
+// for every half-edge (3*triangle + corner, starting at that corner)
+// find the index of its opposite half-edge, or -1 on a boundary
+void ComputeOpposites(const unsigned int *indices, int num_triangles,
+                      std::vector<int> &opposites);
+
+// fast 64 bit (non cryptographic) hash of a block of memory
+unsigned long long HashBytes(const void *data, size_t size,
+                             unsigned long long seed = 0x84222325cbf29ce4ULL);
+
+// ======================================================================
+// STL PARSING
+// Reads binary & ASCII .stl files.  STL stores every triangle with its
+// own 3 corners, use WeldVertices to turn them into shared vertices.
+// ======================================================================
+
+bool ParseSTL(const char *data, size_t size, IndexedMesh &result);
+
+// picks the parser from the file extension (.stl, otherwise .obj)
+bool ParseMeshFile(const std::string &filename, const char *data, size_t size,
+                   IndexedMesh &result);
+
+// lower case extension of a filename, without the '.'
+std::string FileExtension(const std::string &filename);
+
+// ======================================================================
+// VERTEX WELDING
+// Merges the vertices closer than tolerance (tolerance 0 merges only
+// identical positions).  The positions are snapped to a grid with cells
+// of size tolerance and hashed into buckets by cell, so only the
+// vertices of neighboring cells are compared.  Every vertex is merged
+// into a representative within tolerance of it, never further (merges
+// don't chain); which vertices become the representatives depends on
+// the order the cells are visited in.  Exact duplicates are merged in
+// parallel; with a tolerance the merging runs on one thread.
+// Triangles that collapse, or that become copies of another triangle,
+// are removed.  A tolerance may still fold two different faces onto the
+// same directed edge, run UnweldDuplicateEdges after welding.  Returns
+// the number of vertices merged away.
+// ======================================================================
+
+int WeldVertices(IndexedMesh &mesh, float tolerance = 0);
+
+// The half-edge Mesh needs every directed edge to belong to one
+// triangle.  A non-manifold or inconsistently wound file (or a weld
+// that folded two faces together) breaks that: a triangle that repeats
+// a directed edge of an earlier one is given its own copies of its 3
+// vertices, so it's kept but no longer connected.  Returns the number
+// of triangles unwelded.
+int UnweldDuplicateEdges(IndexedMesh &mesh);
+
+// ======================================================================
+// Streaming triangle input, for meshes too large to load as a whole.
+// The file (.obj, binary or ASCII .stl) is memory mapped and read a
+// chunk at a time; each chunk comes out as a flat list of triangle
+// corners (3 positions per triangle).  STL needs no memory beyond the
+// chunk.  OBJ faces may refer to any earlier vertex, so Open() first
+// makes a pass over the file that writes all the vertex positions to a
+// temporary file, which is mapped: the faces page their corners in from
+// there instead of the positions being held in memory.
+// ======================================================================
+
+class TriangleStream {
+
+public:
+
+  TriangleStream() { binary_stl = false; ascii_stl = false; position = 0; error = false;
+                     obj_positions_file = NULL; num_obj_vertices = 0; }
+  ~TriangleStream() { Close(); }
+
+  bool Open(const std::string &filename);
+  // replaces corners with the triangles of the next ~chunk_bytes of the
+  // file, returns false once the file is exhausted (or on an error)
+  bool ReadChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners);
+
+  // =========
+  // ACCESSORS
+  bool hadError() const { return error; }
+  size_t fileSize() const { return file.size(); }
+  size_t bytesRead() const { return position; }
+
+private:
+
+  TriangleStream(const TriangleStream&) { assert(0); }
+  TriangleStream& operator=(const TriangleStream&) { assert(0); exit(0); }
+
+  void Close();
+  // the first pass over an .obj file
+  bool WriteOBJPositions();
+  bool ReadOBJChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners);
+  bool ReadBinarySTLChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners);
+  bool ReadASCIISTLChunk(size_t chunk_bytes, std::vector<glm::vec3> &corners);
+
+  // ==============
+  // REPRESENTATION
+  MappedFile file;
+  bool binary_stl;
+  bool ascii_stl;
+  // bytes of the file consumed so far
+  size_t position;
+  // obj: the positions of all the vertices (a temporary file & its
+  // mapping), and the number of them the faces read so far may use
+  FILE *obj_positions_file;
+  MappedFile obj_positions;
+  long long num_obj_vertices;
+  // ascii stl: corners of a facet that straddles two chunks
+  std::vector<glm::vec3> pending;
+  bool error;
+};
+
+// ======================================================================
+// Streaming binary STL output.  Triangles are packed straight into a
+// large buffer that is flushed with a single fwrite when full; the
+// triangle count in the header is patched in by Close().
+// ======================================================================
+
+class STLWriter {
+
+public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  STLWriter();
+  ~STLWriter() { Close(); }
+
+  bool Open(const std::string &filename);
+  void AddTriangle(const glm::vec3 &normal,
+                   const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+  // returns false if anything went wrong since Open
+  bool Close();
+
+  unsigned int numTriangles() const { return num_triangles; }
+
+private:
+
+  STLWriter(const STLWriter&) { assert(0); }
+  STLWriter& operator=(const STLWriter&) { assert(0); exit(0); }
+
+  void Flush();
+
+  // ==============
+  // REPRESENTATION
+  FILE *fp;
+  std::vector<char> buffer;
+  size_t used;
+  unsigned int num_triangles;
+  bool ok;
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+#include "partitionbuffers.h"
+#include "bsptree.h"
+#include "argparser.h"
+#include "vbo_structs.h"
+#include "utils.h"
+
+// binding point of the PartColors uniform block, & the texture unit of
+// the triangleEdges buffer texture
+#define PART_COLORS_BINDING 0
+#define TRIANGLE_EDGES_UNIT 0
+
+// the simplified parts cluster their vertices on a grid this many cells
+// along the longest side of the part, and are kept when they have at
+// most this fraction of the triangles
+#define LOD_GRID_CELLS 32
+#define LOD_MAX_FRACTION 0.5
+// parts are drawn simplified while a grid cell covers fewer pixels than
+// this
+#define LOD_CELL_PIXELS 3
+
+// ======================================================================
+
+PartitionBuffers::PartitionBuffers() {
+  vao = verts_VBO = indices_VBO = colors_UBO = 0;
+  edges_TBO = edges_texture = 0;
+  firstTriangleID = -1;
+  drawn_triangles = 0;
+}
+
+void PartitionBuffers::initializeVBOs(GLuint programID) {
+  HandleGLError("enter PartitionBuffers::initializeVBOs()");
+  glGenVertexArrays(1, &vao);
+  glGenBuffers(1, &verts_VBO);
+  glGenBuffers(1, &indices_VBO);
+  glGenBuffers(1, &colors_UBO);
+  glGenBuffers(1, &edges_TBO);
+  glGenTextures(1, &edges_texture);
+
+  // (the buffer texture reads the buffer as it is whenever it's used,
+  // so it's attached once)
+  glBindBuffer(GL_TEXTURE_BUFFER, edges_TBO);
+  glBufferData(GL_TEXTURE_BUFFER, 1, NULL, GL_STATIC_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, edges_texture);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, edges_TBO);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  glUseProgram(programID);
+  glUniform1i(glGetUniformLocation(programID, "triangleEdges"), TRIANGLE_EDGES_UNIT);
+  firstTriangleID = glGetUniformLocation(programID, "firstTriangle");
+
+  GLuint block = glGetUniformBlockIndex(programID, "PartColors");
+  if (block != GL_INVALID_INDEX) {
+    glUniformBlockBinding(programID, block, PART_COLORS_BINDING);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, colors_UBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::vec4) * MAX_PART_COLORS, NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  // the attribute layout is recorded in the vertex array object once
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, verts_VBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_VBO);
+  GLsizei stride = sizeof(VBOPartVertex);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offsetof(VBOPartVertex, x)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, BUFFER_OFFSET(offsetof(VBOPartVertex, normal)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, stride, BUFFER_OFFSET(offsetof(VBOPartVertex, part)));
+  glBindVertexArray(0);
+  HandleGLError("leaving PartitionBuffers::initializeVBOs()");
+}
+
+void PartitionBuffers::setupVBOs(BSPTree *tree, ArgParser *args) {
+  HandleGLError("enter PartitionBuffers::setupVBOs()");
+  std::vector<BSPTree*> leaves;
+  tree->getLeaves(leaves);
+  // (the only option the vertex data depends on is the normals)
+  bool gouraud = args->gouraud_normals;
+
+  // remake the parts that are out of date
+  bool relayout = (leaves.size() != parts.size());
+  parts.resize(leaves.size());
+  std::vector<bool> dirty(parts.size(), false);
+  std::vector<glm::vec4> colors(MAX_PART_COLORS, glm::vec4(1,1,1,1));
+  for (unsigned int i = 0; i < leaves.size(); i++) {
+    const Mesh &mesh = leaves[i]->getMesh();
+    Part &p = parts[i];
+    if (i < MAX_PART_COLORS) colors[i] = mesh.getColor();
+    if (p.mesh_id == mesh.getID() && p.gouraud == gouraud && !mesh.isVBODirty()) continue;
+    unsigned int num_verts = p.verts.size();
+    unsigned int num_indices = p.indices.size();
+    unsigned int num_lod_indices = p.lod_indices.size();
+    p.verts.clear();
+    p.indices.clear();
+    p.edges.clear();
+    p.lod_indices.clear();
+    p.lod_edges.clear();
+    mesh.AppendVBOData(i, p.verts, p.indices, p.edges);
+    mesh.setVBOClean();
+    p.bbox_min = mesh.getBoundingBox().getMin();
+    p.bbox_max = mesh.getBoundingBox().getMax();
+    Simplify(p);
+    p.mesh_id = mesh.getID();
+    p.gouraud = gouraud;
+    dirty[i] = true;
+    if (p.verts.size() != num_verts || p.indices.size() != num_indices ||
+        p.lod_indices.size() != num_lod_indices) {
+      relayout = true;
+    }
+  }
+
+  // (the index buffer is bound through the vertex array object)
+  glBindVertexArray(vao);
+  if (relayout) {
+    // lay out all the parts again
+    std::vector<VBOPartVertex> verts;
+    std::vector<VBOIndexedTri> indices;
+    std::vector<unsigned char> edges;
+    for (unsigned int i = 0; i < parts.size(); i++) {
+      Part &p = parts[i];
+      p.first_vertex = verts.size();
+      p.first_index = indices.size();
+      p.first_lod_index = p.first_index + p.indices.size();
+      verts.insert(verts.end(), p.verts.begin(), p.verts.end());
+      indices.insert(indices.end(), p.indices.begin(), p.indices.end());
+      indices.insert(indices.end(), p.lod_indices.begin(), p.lod_indices.end());
+      edges.insert(edges.end(), p.edges.begin(), p.edges.end());
+      edges.insert(edges.end(), p.lod_edges.begin(), p.lod_edges.end());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, verts_VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(VBOPartVertex) * verts.size(), verts.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(VBOIndexedTri) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, edges_TBO);
+    glBufferData(GL_TEXTURE_BUFFER, edges.size(), edges.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  } else {
+    // same sizes, so only the changed ranges are written
+    glBindBuffer(GL_ARRAY_BUFFER, verts_VBO);
+    glBindBuffer(GL_TEXTURE_BUFFER, edges_TBO);
+    for (unsigned int i = 0; i < parts.size(); i++) {
+      if (!dirty[i] || parts[i].indices.empty()) continue;
+      const Part &p = parts[i];
+      glBufferSubData(GL_ARRAY_BUFFER, sizeof(VBOPartVertex) * p.first_vertex,
+                      sizeof(VBOPartVertex) * p.verts.size(), p.verts.data());
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(VBOIndexedTri) * p.first_index,
+                      sizeof(VBOIndexedTri) * p.indices.size(), p.indices.data());
+      glBufferSubData(GL_TEXTURE_BUFFER, p.first_index, p.edges.size(), p.edges.data());
+      if (!p.lod_indices.empty()) {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(VBOIndexedTri) * p.first_lod_index,
+                        sizeof(VBOIndexedTri) * p.lod_indices.size(), p.lod_indices.data());
+        glBufferSubData(GL_TEXTURE_BUFFER, p.first_lod_index, p.lod_edges.size(), p.lod_edges.data());
+      }
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+  glBindVertexArray(0);
+
+  // the colours are tiny, they're always sent
+  glBindBuffer(GL_UNIFORM_BUFFER, colors_UBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::vec4) * MAX_PART_COLORS, colors.data());
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  HandleGLError("leaving PartitionBuffers::setupVBOs()");
+}
+
+void PartitionBuffers::Simplify(Part &p) {
+  // (vertex clustering: every vertex moves to the first vertex of its
+  // grid cell)
+  glm::vec3 size = p.bbox_max - p.bbox_min;
+  float cell = std::max(size.x, std::max(size.y, size.z)) / LOD_GRID_CELLS;
+  if (cell <= 0) return;
+  std::unordered_map<unsigned long long, unsigned int> cells;
+  std::vector<unsigned int> remap(p.verts.size());
+  for (unsigned int i = 0; i < p.verts.size(); i++) {
+    const VBOPartVertex &v = p.verts[i];
+    glm::vec3 c = (glm::vec3(v.x, v.y, v.z) - p.bbox_min) / cell;
+    // (LOD_GRID_CELLS + 1 cells at most along each axis)
+    unsigned long long key =
+      (unsigned long long)std::min<int>(c.x, LOD_GRID_CELLS) |
+      ((unsigned long long)std::min<int>(c.y, LOD_GRID_CELLS) << 16) |
+      ((unsigned long long)std::min<int>(c.z, LOD_GRID_CELLS) << 32);
+    remap[i] = cells.insert(std::make_pair(key, i)).first->second;
+  }
+  for (unsigned int i = 0; i < p.indices.size(); i++) {
+    unsigned int a = remap[p.indices[i].verts[0]];
+    unsigned int b = remap[p.indices[i].verts[1]];
+    unsigned int c = remap[p.indices[i].verts[2]];
+    if (a == b || b == c || c == a) continue;
+    p.lod_indices.push_back(VBOIndexedTri(a, b, c));
+    p.lod_edges.push_back(p.edges[i]);
+  }
+  if (p.lod_indices.size() > LOD_MAX_FRACTION * p.indices.size()) {
+    p.lod_indices.clear();
+    p.lod_edges.clear();
+  }
+}
+
+bool PartitionBuffers::InFrustum(const glm::mat4 &MVP, const glm::vec3 &min, const glm::vec3 &max) {
+  // the 6 clip planes are sums & differences of the rows of MVP; the
+  // box is outside when its corner furthest along a plane's normal is
+  // behind it
+  glm::vec4 row[4];
+  for (int i = 0; i < 4; i++) row[i] = glm::vec4(MVP[0][i], MVP[1][i], MVP[2][i], MVP[3][i]);
+  for (int i = 0; i < 6; i++) {
+    glm::vec4 plane = (i % 2 == 0) ? row[3] + row[i/2] : row[3] - row[i/2];
+    glm::vec3 corner(plane.x > 0 ? max.x : min.x,
+                     plane.y > 0 ? max.y : min.y,
+                     plane.z > 0 ? max.z : min.z);
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0) return false;
+  }
+  return true;
+}
+
+float PartitionBuffers::ScreenSize(const glm::mat4 &MVP, int width, int height,
+                                   const glm::vec3 &min, const glm::vec3 &max) {
+  glm::vec2 lo(std::numeric_limits<float>::max());
+  glm::vec2 hi(-std::numeric_limits<float>::max());
+  for (int i = 0; i < 8; i++) {
+    glm::vec4 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1);
+    glm::vec4 clip = MVP * corner;
+    // (a corner at or behind the eye: the part fills the view)
+    if (clip.w <= 0) return 0;
+    glm::vec2 ndc = glm::vec2(clip) / clip.w;
+    lo = glm::min(lo, ndc);
+    hi = glm::max(hi, ndc);
+  }
+  return std::max(0.5f * width * (hi.x - lo.x), 0.5f * height * (hi.y - lo.y));
+}
+
+void PartitionBuffers::drawVBOs(const glm::mat4 &MVP, int width, int height, bool full_detail, bool wireframe) {
+  HandleGLError("enter PartitionBuffers::drawVBOs()");
+  // what's drawn of every part this frame
+  counts.clear();
+  offsets.clear();
+  base_vertices.clear();
+  first_triangles.clear();
+  drawn_triangles = 0;
+  for (unsigned int i = 0; i < parts.size(); i++) {
+    const Part &p = parts[i];
+    if (p.indices.empty()) continue;
+    GLsizeiptr first = p.first_index;
+    GLsizei num_tris = p.indices.size();
+    if (!full_detail) {
+      if (!InFrustum(MVP, p.bbox_min, p.bbox_max)) continue;
+      if (!p.lod_indices.empty()) {
+        float pixels = ScreenSize(MVP, width, height, p.bbox_min, p.bbox_max);
+        if (pixels > 0 && pixels < LOD_GRID_CELLS * LOD_CELL_PIXELS) {
+          first = p.first_lod_index;
+          num_tris = p.lod_indices.size();
+        }
+      }
+    }
+    counts.push_back(num_tris * 3);
+    offsets.push_back(BUFFER_OFFSET(first * sizeof(VBOIndexedTri)));
+    base_vertices.push_back(p.first_vertex);
+    first_triangles.push_back(first);
+    drawn_triangles += num_tris;
+  }
+  if (counts.empty()) return;
+  bindForDrawing();
+  if (wireframe) {
+    for (unsigned int i = 0; i < counts.size(); i++) {
+      glUniform1i(firstTriangleID, first_triangles[i]);
+      glDrawElementsBaseVertex(GL_TRIANGLES, counts[i], GL_UNSIGNED_INT, offsets[i], base_vertices[i]);
+    }
+  } else {
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(),
+                                  counts.size(), base_vertices.data());
+  }
+  glBindVertexArray(0);
+  HandleGLError("leaving PartitionBuffers::drawVBOs()");
+}
+
+void PartitionBuffers::drawPart(unsigned int i) {
+  if (i >= parts.size() || parts[i].indices.empty()) return;
+  const Part &p = parts[i];
+  bindForDrawing();
+  glUniform1i(firstTriangleID, p.first_index);
+  glDrawElementsBaseVertex(GL_TRIANGLES, p.indices.size() * 3, GL_UNSIGNED_INT,
+                           BUFFER_OFFSET(p.first_index * sizeof(VBOIndexedTri)), p.first_vertex);
+  glBindVertexArray(0);
+}
+
+void PartitionBuffers::bindForDrawing() {
+  glBindVertexArray(vao);
+  glBindBufferBase(GL_UNIFORM_BUFFER, PART_COLORS_BINDING, colors_UBO);
+  glActiveTexture(GL_TEXTURE0 + TRIANGLE_EDGES_UNIT);
+  glBindTexture(GL_TEXTURE_BUFFER, edges_texture);
+}
+
+void PartitionBuffers::cleanupVBOs() {
+  // (0 = never initialized)
+  if (vao == 0) return;
+  glDeleteVertexArrays(1, &vao);
+  glDeleteBuffers(1, &verts_VBO);
+  glDeleteBuffers(1, &indices_VBO);
+  glDeleteBuffers(1, &colors_UBO);
+  glDeleteTextures(1, &edges_texture);
+  glDeleteBuffers(1, &edges_TBO);
+  vao = verts_VBO = indices_VBO = colors_UBO = 0;
+  edges_TBO = edges_texture = 0;
+  parts.clear();
+  counts.clear();
+  offsets.clear();
+  base_vertices.clear();
+  first_triangles.clear();
+}
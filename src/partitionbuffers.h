@@ -0,0 +1,127 @@
+#ifndef _PARTITION_BUFFERS_H_
+#define _PARTITION_BUFFERS_H_
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "vbo_structs.h"
+
+class ArgParser;
+class BSPTree;
+
+// ======================================================================
+// The GL buffers all the partitions (leaves) of a BSPTree are drawn
+// from.  The triangles of every leaf go into one vertex & index buffer
+// pair, with a table of the range of each part, and the vertex array
+// object records the attribute setup once.  The colours of the parts
+// are a uniform block the shader indexes by the part number in each
+// vertex, so the whole tree is a single glMultiDrawElementsBaseVertex
+// call however many parts it has.
+//
+// The vertices are shared between the triangles whether or not the
+// wireframe is drawn.  The kinds of the edges of every triangle (see
+// vbo_structs.h) are a byte in a buffer texture laid out like the index
+// buffer; the geometry shader finds a triangle's byte from its
+// gl_PrimitiveIDIn and the first triangle of the draw (a uniform).
+// gl_PrimitiveIDIn isn't reliably restarted between the draws of a
+// glMultiDrawElementsBaseVertex (Mesa keeps counting), so the wireframe
+// draws the parts one call each.
+//
+// The vertex data of every part is kept, with the mesh & normals it was
+// made from, and setupVBOs only remakes the parts whose mesh was
+// replaced or changed (Mesh::isVBODirty) or whose normals differ.
+// Those are written over their old range with glBufferSubData; only
+// when the size of a part changes is the whole buffer laid out again.
+//
+// Big trees are thinned out before drawing: parts whose bounding box is
+// outside the view frustum are skipped, and parts that look small on
+// the screen are drawn from a simplified copy of their triangles (the
+// vertices clustered on a coarse grid, the triangles that collapse
+// dropped).  The simplified triangles index the part's own vertices,
+// so they only add to the index buffer, and keep the edge kinds of the
+// triangles they came from.
+// ======================================================================
+
+// (the size of the PartColors uniform block in the vertex shader; with
+// more parts the colours repeat)
+#define MAX_PART_COLORS 1024
+
+class PartitionBuffers {
+
+public:
+
+  PartitionBuffers();
+
+  // creates the GL objects (the program is the one drawing the parts)
+  void initializeVBOs(GLuint programID);
+  // brings the buffers up to date with the leaves of tree
+  void setupVBOs(BSPTree *tree, ArgParser *args);
+  // MVP is the model-view-projection matrix the parts are drawn with,
+  // in a window of width x height pixels (for culling & choosing the
+  // level of detail; full_detail turns both off), wireframe if the
+  // shader draws the edges
+  void drawVBOs(const glm::mat4 &MVP, int width, int height, bool full_detail, bool wireframe);
+  // just part i, at full detail
+  void drawPart(unsigned int i);
+  void cleanupVBOs();
+
+  unsigned int numParts() const { return parts.size(); }
+  // what the last drawVBOs drew
+  unsigned int numDrawnParts() const { return counts.size(); }
+  unsigned int numDrawnTriangles() const { return drawn_triangles; }
+
+private:
+
+  struct Part {
+    Part() : mesh_id(0), gouraud(false), first_vertex(0), first_index(0), first_lod_index(0) {}
+    // what the data was made from (mesh 0 = nothing yet)
+    unsigned int mesh_id;
+    bool gouraud;
+    // (indices relative to the part's first vertex, one edges byte per
+    // triangle)
+    std::vector<VBOPartVertex> verts;
+    std::vector<VBOIndexedTri> indices;
+    std::vector<unsigned char> edges;
+    // the simplified triangles (empty = not worth having one)
+    std::vector<VBOIndexedTri> lod_indices;
+    std::vector<unsigned char> lod_edges;
+    glm::vec3 bbox_min;
+    glm::vec3 bbox_max;
+    // where it is in the buffers (the simplified triangles follow the
+    // others)
+    GLint first_vertex;
+    GLsizeiptr first_index;
+    GLsizeiptr first_lod_index;
+  };
+
+  static void Simplify(Part &p);
+  // binds the vertex array & what the shaders look up
+  void bindForDrawing();
+  // false if the box is entirely outside the frustum of MVP
+  static bool InFrustum(const glm::mat4 &MVP, const glm::vec3 &min, const glm::vec3 &max);
+  // how many pixels wide or high the box looks (0 = too close to tell)
+  static float ScreenSize(const glm::mat4 &MVP, int width, int height,
+                          const glm::vec3 &min, const glm::vec3 &max);
+
+  // ==============
+  // REPRESENTATION
+  GLuint vao;
+  GLuint verts_VBO;
+  GLuint indices_VBO;
+  GLuint colors_UBO;
+  // the edges byte of every triangle of indices_VBO (a texture buffer)
+  GLuint edges_TBO;
+  GLuint edges_texture;
+  GLint firstTriangleID;
+  std::vector<Part> parts;
+  // the glMultiDrawElementsBaseVertex arguments of the last frame
+  std::vector<GLsizei> counts;
+  std::vector<const GLvoid*> offsets;
+  std::vector<GLint> base_vertices;
+  // (the first triangle of every draw, for the wireframe)
+  std::vector<GLint> first_triangles;
+  unsigned int drawn_triangles;
+};
+
+#endif
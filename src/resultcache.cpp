@@ -0,0 +1,195 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#define getpid _getpid
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#include "bsptree.h"
+#include "argparser.h"
+#include "cutplan.h"
+#include "meshio.h"
+#include "resultcache.h"
+
+static const char result_cache_magic[8] = { 'A','C','G','R','S','L','T','\0' };
+
+// ======================================================================
+
+SearchKey MakeSearchKey(unsigned long long mesh_hash, ArgParser *args) {
+  SearchKey key;
+  // (no padding in the struct, but clear it anyway so it hashes cleanly)
+  memset(&key, 0, sizeof(key));
+  key.version = RESULT_CACHE_VERSION;
+  key.beam_width = args->beam_width;
+  key.mesh_hash = mesh_hash;
+  key.printing_size[0] = args->printing_width;
+  key.printing_size[1] = args->printing_height;
+  key.printing_size[2] = args->printing_length;
+  key.offset_increment = args->offset_increment;
+  key.a_part = args->a_part;
+  key.a_util = args->a_util;
+  key.a_connector = args->a_connector;
+  key.weld_tolerance = args->effectiveWeldTolerance();
+  return key;
+}
+
+std::string ResultCacheDirectory(ArgParser *args) {
+  if (args->result_cache_dir != "") {
+    return args->result_cache_dir;
+  }
+  return args->path + "/result_cache";
+}
+
+static std::string EntryFilename(const std::string &directory, const SearchKey &key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx", HashBytes(&key, sizeof(key)));
+  return directory + "/" + name + RESULT_CACHE_EXTENSION;
+}
+
+// ======================================================================
+// DIRECTORY HELPERS
+// ======================================================================
+
+struct CacheEntry {
+  std::string filename;
+  unsigned long long size;
+  long long time;
+};
+
+static bool OldestFirst(const CacheEntry &a, const CacheEntry &b) {
+  return a.time < b.time;
+}
+
+static void MakeDirectory(const std::string &directory) {
+#if defined(_WIN32)
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0777);
+#endif
+}
+
+// marks an entry as recently used
+static void Touch(const std::string &filename) {
+#if defined(_WIN32)
+  _utime(filename.c_str(), NULL);
+#else
+  utime(filename.c_str(), NULL);
+#endif
+}
+
+static void ListEntries(const std::string &directory, std::vector<CacheEntry> &entries) {
+  size_t ext_length = strlen(RESULT_CACHE_EXTENSION);
+#if defined(_WIN32)
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA((directory + "/*" + RESULT_CACHE_EXTENSION).c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE) return;
+  do {
+    CacheEntry entry;
+    entry.filename = directory + "/" + data.cFileName;
+    entry.size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    entry.time = ((long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    entries.push_back(entry);
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) return;
+  struct dirent *d;
+  while ((d = readdir(dir)) != NULL) {
+    std::string name = d->d_name;
+    if (name.size() <= ext_length ||
+        name.compare(name.size() - ext_length, ext_length, RESULT_CACHE_EXTENSION) != 0) continue;
+    CacheEntry entry;
+    entry.filename = directory + "/" + name;
+    struct stat st;
+    // (another process may have just removed it)
+    if (stat(entry.filename.c_str(), &st) != 0) continue;
+    entry.size = st.st_size;
+    entry.time = st.st_mtime;
+    entries.push_back(entry);
+  }
+  closedir(dir);
+#endif
+  (void)ext_length;
+}
+
+// deletes the least recently used entries (except keep, the one just
+// written) until the rest fit in max_bytes
+static void Evict(const std::string &directory, unsigned long long max_bytes,
+                  const std::string &keep) {
+  std::vector<CacheEntry> entries;
+  ListEntries(directory, entries);
+  unsigned long long total = 0;
+  for (unsigned int i = 0; i < entries.size(); i++) {
+    total += entries[i].size;
+  }
+  if (total <= max_bytes) return;
+  std::sort(entries.begin(), entries.end(), OldestFirst);
+  for (unsigned int i = 0; i < entries.size() && total > max_bytes; i++) {
+    if (entries[i].filename == keep) continue;
+    // if another process got there first, that's fine too
+    remove(entries[i].filename.c_str());
+    total -= entries[i].size;
+  }
+}
+
+// ======================================================================
+
+bool LookupResult(const std::string &directory, const SearchKey &key, CutPlan &plan) {
+  std::string filename = EntryFilename(directory, key);
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (fp == NULL) return false;
+  char magic[8];
+  SearchKey stored;
+  bool ok = fread(magic, 8, 1, fp) == 1 &&
+    memcmp(magic, result_cache_magic, 8) == 0 &&
+    fread(&stored, sizeof(stored), 1, fp) == 1 &&
+    memcmp(&stored, &key, sizeof(key)) == 0 &&
+    plan.Read(fp);
+  fclose(fp);
+  if (ok) Touch(filename);
+  return ok;
+}
+
+bool StoreResult(const std::string &directory, unsigned long long max_bytes,
+                 const SearchKey &key, const CutPlan &plan) {
+  MakeDirectory(directory);
+  std::string filename = EntryFilename(directory, key);
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".tmp%d", (int)getpid());
+  std::string temp_file = filename + suffix;
+  FILE *fp = fopen(temp_file.c_str(), "wb");
+  if (fp == NULL) {
+    std::cout << "WARNING: cannot write result cache '" << filename << "'" << std::endl;
+    return false;
+  }
+  bool ok = fwrite(result_cache_magic, 8, 1, fp) == 1 &&
+    fwrite(&key, sizeof(key), 1, fp) == 1 &&
+    plan.Write(fp);
+  ok = (fclose(fp) == 0) && ok;
+#if defined(_WIN32)
+  // rename won't replace an existing file on Windows
+  if (ok) remove(filename.c_str());
+#endif
+  if (!ok || rename(temp_file.c_str(), filename.c_str()) != 0) {
+    std::cout << "WARNING: cannot write result cache '" << filename << "'" << std::endl;
+    remove(temp_file.c_str());
+    return false;
+  }
+  Evict(directory, max_bytes, filename);
+  return true;
+}
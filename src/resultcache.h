@@ -0,0 +1,51 @@
+#ifndef _RESULT_CACHE_H_
+#define _RESULT_CACHE_H_
+
+#include <string>
+
+class ArgParser;
+class CutPlan;
+
+// ======================================================================
+// On-disk cache of search results.  Each entry holds the cut plan (with
+// its grades) that the beam search found for one mesh file and one set
+// of search parameters, and is named after a hash of both, so an
+// identical job can replay the plan instead of searching again.
+//
+// The directory may be shared by several processes: entries are written
+// to a temporary file & renamed into place, and readers check the full
+// key stored in the entry.  A hit refreshes the entry's time stamp; when
+// the directory grows over its size limit the least recently used
+// entries are deleted.
+// ======================================================================
+
+#define RESULT_CACHE_EXTENSION ".result"
+// bump whenever the search itself changes, to invalidate old results
+#define RESULT_CACHE_VERSION 4
+
+// everything the search result depends on
+struct SearchKey {
+  unsigned int version;
+  unsigned int beam_width;
+  unsigned long long mesh_hash;
+  float printing_size[3];
+  float offset_increment;
+  float a_part;
+  float a_util;
+  float a_connector;
+  float weld_tolerance;
+};
+
+SearchKey MakeSearchKey(unsigned long long mesh_hash, ArgParser *args);
+
+// the -result_cache directory, or "result_cache" next to the input
+std::string ResultCacheDirectory(ArgParser *args);
+
+// fills plan & returns true on a hit
+bool LookupResult(const std::string &directory, const SearchKey &key, CutPlan &plan);
+
+// adds (or replaces) an entry, then trims the directory to max_bytes
+bool StoreResult(const std::string &directory, unsigned long long max_bytes,
+                 const SearchKey &key, const CutPlan &plan);
+
+#endif
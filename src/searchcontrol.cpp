@@ -0,0 +1,31 @@
+#include <chrono>
+#include <thread>
+
+#include "searchcontrol.h"
+#include "bsptree.h"
+
+// ======================================================================
+
+SearchControl::SearchControl()
+  : cancelled(false), paused(false), done(false), iteration(0), candidates(0), snapshot(NULL) {
+}
+
+SearchControl::~SearchControl() {
+  delete snapshot.exchange(NULL);
+}
+
+void SearchControl::WaitWhilePaused() const {
+  while (paused && !cancelled) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+}
+
+void SearchControl::Publish(BSPTree *tree) {
+  // (an older snapshot the window never took is simply dropped)
+  delete snapshot.exchange(tree);
+}
+
+void SearchControl::Finish(BSPTree *result) {
+  Publish(result);
+  done = true;
+}
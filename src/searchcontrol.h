@@ -0,0 +1,71 @@
+#ifndef _SEARCH_CONTROL_H_
+#define _SEARCH_CONTROL_H_
+
+#include <atomic>
+
+class BSPTree;
+
+// ======================================================================
+// Shared between a beam search running on its own thread and the window
+// that started it.  The window can pause or cancel the search and reads
+// its progress; the search hands over a copy of its best tree after
+// every iteration & its result at the end.
+//
+// Trees are handed over through a single atomic slot: Publish()
+// replaces the tree waiting there (deleting it if the window hasn't
+// taken it yet) and TakeSnapshot() empties it, so neither side ever
+// waits for the other.
+// ======================================================================
+
+class SearchControl {
+
+public:
+
+  SearchControl();
+  // (deletes a tree nobody took)
+  ~SearchControl();
+
+  // ==================
+  // FROM THE WINDOW
+  void Cancel() { cancelled = true; }
+  void setPaused(bool p) { paused = p; }
+  // the latest tree published (or NULL), the caller owns it
+  BSPTree* TakeSnapshot() { return snapshot.exchange(NULL); }
+
+  // =================
+  // FROM THE SEARCH
+  // (from any of its threads)
+  // returns once the search isn't paused (or is cancelled)
+  void WaitWhilePaused() const;
+  void setIteration(int i) { iteration = i; }
+  void addCandidates(int n) { candidates += n; }
+  // takes ownership of tree
+  void Publish(BSPTree *tree);
+  // publishes the result, the search thread may be joined after this
+  void Finish(BSPTree *result);
+
+  // =========
+  // PROGRESS
+  bool isCancelled() const { return cancelled; }
+  bool isPaused() const { return paused; }
+  bool isDone() const { return done; }
+  int getIteration() const { return iteration; }
+  // candidate cuts evaluated so far
+  unsigned long long numCandidates() const { return candidates; }
+
+private:
+
+  SearchControl(const SearchControl&) = delete;
+  SearchControl& operator=(const SearchControl&) = delete;
+
+  // ==============
+  // REPRESENTATION
+  std::atomic<bool> cancelled;
+  std::atomic<bool> paused;
+  std::atomic<bool> done;
+  std::atomic<int> iteration;
+  std::atomic<unsigned long long> candidates;
+  std::atomic<BSPTree*> snapshot;
+};
+
+#endif
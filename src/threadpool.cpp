@@ -0,0 +1,132 @@
+#include <algorithm>
+
+#include "threadpool.h"
+
+// the pool & worker the current thread belongs to (if any)
+static thread_local ThreadPool *current_pool = NULL;
+static thread_local unsigned int current_worker = 0;
+
+// ======================================================================
+
+ThreadPool::ThreadPool(unsigned int num_threads) : next_worker(0), num_queued(0), num_running(0), num_reserved(0) {
+  num_pending = 0;
+  stopping = false;
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned int i = 0; i < num_threads; i++) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker()));
+  }
+  for (unsigned int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  task_available.notify_all();
+  for (unsigned int i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+}
+
+void ThreadPool::Submit(const std::function<void()> &task) {
+  unsigned int worker;
+  bool from_task = (current_pool == this);
+  if (from_task) {
+    worker = current_worker;
+  } else {
+    worker = next_worker++ % workers.size();
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    num_pending++;
+  }
+  {
+    std::unique_lock<std::mutex> lock(workers[worker]->mutex);
+    if (from_task) {
+      workers[worker]->tasks.push_back(task);
+    } else {
+      workers[worker]->tasks.push_front(task);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    num_queued++;
+  }
+  task_available.notify_one();
+}
+
+unsigned int ThreadPool::numIdle() const {
+  int idle = (int)threads.size() - num_running - num_queued - num_reserved;
+  return std::max(0, idle);
+}
+
+unsigned int ThreadPool::ReserveIdle() {
+  int reserved = num_reserved;
+  while (true) {
+    int idle = (int)threads.size() - num_running - num_queued - reserved;
+    if (idle <= 0) return 0;
+    // (fails & reloads reserved if another task reserved meanwhile)
+    if (num_reserved.compare_exchange_weak(reserved, reserved + idle)) return idle;
+  }
+}
+
+void ThreadPool::ReleaseIdle(unsigned int count) {
+  num_reserved -= count;
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (num_pending > 0) {
+    all_done.wait(lock);
+  }
+}
+
+// (a worker's own end of its queue is the back, thieves take the front)
+bool ThreadPool::PopLocal(unsigned int worker, std::function<void()> &task) {
+  std::unique_lock<std::mutex> lock(workers[worker]->mutex);
+  if (workers[worker]->tasks.empty()) return false;
+  task = workers[worker]->tasks.back();
+  workers[worker]->tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::Steal(unsigned int worker, std::function<void()> &task) {
+  unsigned int n = workers.size();
+  for (unsigned int i = 1; i < n; i++) {
+    Worker &victim = *workers[(worker + i) % n];
+    std::unique_lock<std::mutex> lock(victim.mutex);
+    if (victim.tasks.empty()) continue;
+    task = victim.tasks.front();
+    victim.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned int worker) {
+  current_pool = this;
+  current_worker = worker;
+  while (true) {
+    std::function<void()> task;
+    if (PopLocal(worker, task) || Steal(worker, task)) {
+      num_running++;
+      num_queued--;
+      task();
+      num_running--;
+      std::unique_lock<std::mutex> lock(mutex);
+      num_pending--;
+      if (num_pending == 0) all_done.notify_all();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    while (num_queued <= 0 && !stopping) {
+      task_available.wait(lock);
+    }
+    if (num_queued <= 0) return;
+  }
+}
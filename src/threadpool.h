@@ -0,0 +1,86 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ======================================================================
+// A fixed set of worker threads with work stealing.  Submit() any number
+// of tasks, then Wait() for all of them to finish.
+//
+// Every worker has its own task queue.  Tasks submitted from outside the
+// pool are dealt to the workers in turn, a task submitted by a running
+// task goes to its own worker's queue, which that worker empties newest
+// first (so a task can split its work into subtasks and run them
+// itself).  A worker whose queue is empty steals the oldest task from
+// another worker, which keeps every thread busy when the tasks are very
+// uneven.
+// ======================================================================
+
+class ThreadPool {
+
+public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  // (0 threads = one per hardware thread)
+  ThreadPool(unsigned int num_threads = 0);
+  ~ThreadPool();
+
+  unsigned int numThreads() const { return threads.size(); }
+  // workers with no task to run right now, nor one waiting in a queue,
+  // nor reserved
+  unsigned int numIdle() const;
+  // reserves the idle workers for the calling task, which may then run
+  // that many more threads of its own until it calls ReleaseIdle (two
+  // tasks never reserve the same workers); returns how many it got
+  unsigned int ReserveIdle();
+  void ReleaseIdle(unsigned int count);
+
+  void Submit(const std::function<void()> &task);
+  // blocks until every submitted task (including the ones submitted by
+  // other tasks) has completed; not to be called from a task
+  void Wait();
+
+private:
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  struct Worker {
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+  };
+
+  // newest task of worker's own queue / oldest task of another queue
+  bool PopLocal(unsigned int worker, std::function<void()> &task);
+  bool Steal(unsigned int worker, std::function<void()> &task);
+  void WorkerLoop(unsigned int worker);
+
+  // ==============
+  // REPRESENTATION
+  std::vector<std::unique_ptr<Worker> > workers;
+  std::vector<std::thread> threads;
+  std::atomic<unsigned int> next_worker;
+  // tasks waiting in a queue (only increased under mutex, so a worker
+  // going to sleep can't miss one)
+  std::atomic<int> num_queued;
+  // tasks being run by a worker
+  std::atomic<int> num_running;
+  // idle workers handed out by ReserveIdle
+  std::atomic<int> num_reserved;
+  // tasks submitted & not finished yet (guarded by mutex)
+  int num_pending;
+  std::mutex mutex;
+  std::condition_variable task_available;
+  std::condition_variable all_done;
+  bool stopping;
+};
+
+#endif
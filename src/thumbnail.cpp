@@ -0,0 +1,397 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "thumbnail.h"
+#include "bsptree.h"
+#include "mesh.h"
+#include "vertex.h"
+#include "camera.h"
+#include "argparser.h"
+#include "threadpool.h"
+#include "utils.h"
+
+// the image is drawn in tiles of TILE_SIZE x TILE_SIZE pixels
+#define TILE_SIZE 64
+
+// ======================================================================
+
+namespace {
+
+// a triangle in window coordinates (pixels, y down, depth -1 to 1) with
+// its shaded colour
+struct ScreenTriangle {
+  float x[3];
+  float y[3];
+  float z[3];
+  unsigned char rgb[3];
+};
+
+// what the shading & the projection need
+struct View {
+  glm::mat4 MVP;
+  glm::mat4 ModelMatrix;
+  glm::vec3 light;
+  glm::vec3 eye;
+  int width;
+  int height;
+};
+
+}
+
+// ======================================================================
+
+// the colour the viewer's shader gives a flat shaded triangle, for the
+// centre of the triangle (a, b, c in world space)
+static glm::vec3 Shade(const View &view, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                       bool front_facing, const glm::vec4 &mesh_color) {
+  glm::vec3 LightColor(1,1,1);
+  float LightPower = 4.0f;
+  glm::vec3 surface_normal = glm::normalize(glm::cross(b - a, c - a));
+  glm::vec3 MaterialDiffuseColor(mesh_color.r, mesh_color.g, mesh_color.b);
+  glm::vec3 MaterialSpecularColor(0.3,0.3,0.3);
+  if (!front_facing) {
+    MaterialDiffuseColor = glm::vec3(0.0,0.0,0.6);
+    MaterialSpecularColor = glm::vec3(0.1,0.1,0.3);
+    surface_normal = -surface_normal;
+  }
+  glm::vec3 MaterialAmbientColor = glm::vec3(0.3,0.3,0.3) * MaterialDiffuseColor;
+
+  glm::vec3 p = (a + b + c) / 3.0f;
+  glm::vec3 dirToLight = view.light - p;
+  float distanceToLight = glm::length(dirToLight);
+  dirToLight = dirToLight / distanceToLight;
+  float cosTheta = glm::clamp(glm::dot(surface_normal, dirToLight), 0.0f, 1.0f);
+  glm::vec3 E = glm::normalize(view.eye - p);
+  glm::vec3 R = glm::reflect(-dirToLight, surface_normal);
+  float cosAlpha = glm::clamp(glm::dot(E, R), 0.0f, 1.0f);
+  glm::vec3 color =
+    MaterialAmbientColor +
+    MaterialDiffuseColor * LightColor * LightPower * cosTheta / distanceToLight +
+    MaterialSpecularColor * LightColor * LightPower * (float)pow(cosAlpha, 5) / distanceToLight;
+  return glm::clamp(color, 0.0f, 1.0f);
+}
+
+// projects & shades the triangles of one leaf (the ones crossing the
+// near plane are left out, the camera is normally outside the model)
+static void ProjectLeaf(const View &view, const Mesh &mesh, std::vector<ScreenTriangle> &tris) {
+  std::vector<unsigned int> corners;
+  mesh.getTriangleCorners(corners);
+  // every vertex once, when a triangle first uses it
+  std::vector<glm::vec4> clip(mesh.numVertices());
+  std::vector<glm::vec3> world(mesh.numVertices());
+  std::vector<char> done(mesh.numVertices(), 0);
+  for (unsigned int i = 0; i < corners.size(); i++) {
+    unsigned int v = corners[i];
+    if (done[v]) continue;
+    glm::vec4 pos(mesh.getVertex(v)->getPos(), 1);
+    clip[v] = view.MVP * pos;
+    world[v] = glm::vec3(view.ModelMatrix * pos);
+    done[v] = 1;
+  }
+
+  tris.reserve(corners.size() / 3);
+  for (unsigned int i = 0; i < corners.size(); i += 3) {
+    ScreenTriangle t;
+    bool visible = true;
+    for (int j = 0; j < 3; j++) {
+      const glm::vec4 &c = clip[corners[i+j]];
+      if (c.w <= 0 || c.z < -c.w) { visible = false; break; }
+      t.x[j] = (c.x / c.w + 1) * 0.5f * view.width;
+      t.y[j] = (1 - c.y / c.w) * 0.5f * view.height;
+      t.z[j] = c.z / c.w;
+    }
+    if (!visible) continue;
+    // (counter clockwise on the screen is the front, with y down that's
+    // a negative area)
+    float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+    if (area == 0) continue;
+    glm::vec3 color = Shade(view, world[corners[i]], world[corners[i+1]], world[corners[i+2]],
+                            area < 0, mesh.getColor());
+    for (int j = 0; j < 3; j++) {
+      t.rgb[j] = (unsigned char)(255 * color[j] + 0.5f);
+    }
+    tris.push_back(t);
+  }
+}
+
+// draws the triangles listed in bin into the tile [x0,x1) x [y0,y1)
+static void DrawTile(const std::vector<ScreenTriangle> &tris, const std::vector<unsigned int> &bin,
+                     int x0, int y0, int x1, int y1, int width,
+                     std::vector<float> &depth, std::vector<unsigned char> &image) {
+  for (unsigned int k = 0; k < bin.size(); k++) {
+    const ScreenTriangle &t = tris[bin[k]];
+    int min_x = std::max(x0, (int)floor(std::min(t.x[0], std::min(t.x[1], t.x[2]))));
+    int max_x = std::min(x1 - 1, (int)ceil(std::max(t.x[0], std::max(t.x[1], t.x[2]))));
+    int min_y = std::max(y0, (int)floor(std::min(t.y[0], std::min(t.y[1], t.y[2]))));
+    int max_y = std::min(y1 - 1, (int)ceil(std::max(t.y[0], std::max(t.y[1], t.y[2]))));
+    if (min_x > max_x || min_y > max_y) continue;
+
+    // edge functions (twice the area of the triangle the edge makes
+    // with the pixel centre), each the weight of the opposite corner,
+    // & how much they change per pixel
+    float sign = ((t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]) > 0) ? 1 : -1;
+    float w_row[3], dx[3], dy[3];
+    for (int j = 0; j < 3; j++) {
+      int a = (j + 1) % 3;
+      int b = (j + 2) % 3;
+      dx[j] = -sign * (t.y[b] - t.y[a]);
+      dy[j] = sign * (t.x[b] - t.x[a]);
+      w_row[j] = sign * ((t.x[b] - t.x[a]) * (min_y + 0.5f - t.y[a]) -
+                         (t.y[b] - t.y[a]) * (min_x + 0.5f - t.x[a]));
+    }
+    float area = w_row[0] + w_row[1] + w_row[2];
+    if (area <= 0) continue;
+    for (int y = min_y; y <= max_y; y++) {
+      float w0 = w_row[0], w1 = w_row[1], w2 = w_row[2];
+      for (int x = min_x; x <= max_x; x++) {
+        if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
+          float z = (w0 * t.z[0] + w1 * t.z[1] + w2 * t.z[2]) / area;
+          int i = y * width + x;
+          // (GL_LESS)
+          if (z < depth[i]) {
+            depth[i] = z;
+            image[3*i] = t.rgb[0];
+            image[3*i+1] = t.rgb[1];
+            image[3*i+2] = t.rgb[2];
+          }
+        }
+        w0 += dx[0]; w1 += dx[1]; w2 += dx[2];
+      }
+      w_row[0] += dy[0]; w_row[1] += dy[1]; w_row[2] += dy[2];
+    }
+  }
+}
+
+// ======================================================================
+// IMAGE FILES
+// ======================================================================
+
+static bool WritePPM(const std::string &filename, int width, int height,
+                     const std::vector<unsigned char> &image) {
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (fp == NULL) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  fprintf(fp, "P6\n%d %d\n255\n", width, height);
+  bool ok = (fwrite(image.data(), 1, image.size(), fp) == image.size());
+  ok = (fclose(fp) == 0) && ok;
+  return ok;
+}
+
+static std::vector<unsigned int> CRC32Table() {
+  std::vector<unsigned int> table(256);
+  for (unsigned int n = 0; n < 256; n++) {
+    unsigned int c = n;
+    for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+  return table;
+}
+
+static unsigned int CRC32(const unsigned char *data, size_t size, unsigned int crc = 0) {
+  static const std::vector<unsigned int> table = CRC32Table();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void PutBigEndian(std::vector<unsigned char> &out, unsigned int value) {
+  for (int shift = 24; shift >= 0; shift -= 8) out.push_back((value >> shift) & 0xff);
+}
+
+static void PutChunk(std::vector<unsigned char> &out, const char *type,
+                     const std::vector<unsigned char> &data) {
+  PutBigEndian(out, data.size());
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  PutBigEndian(out, CRC32(&out[start], out.size() - start));
+}
+
+// an RGB .png with the pixels stored (deflate blocks without
+// compression, so no zlib is needed)
+static bool WritePNG(const std::string &filename, int width, int height,
+                     const std::vector<unsigned char> &image) {
+  std::vector<unsigned char> header;
+  PutBigEndian(header, width);
+  PutBigEndian(header, height);
+  // 8 bit RGB, deflate, no filtering, not interlaced
+  unsigned char format[5] = { 8, 2, 0, 0, 0 };
+  header.insert(header.end(), format, format + 5);
+
+  // every row starts with its filter (0 = none)
+  std::vector<unsigned char> rows;
+  rows.reserve((3 * width + 1) * height);
+  for (int y = 0; y < height; y++) {
+    rows.push_back(0);
+    rows.insert(rows.end(), image.begin() + 3 * width * y, image.begin() + 3 * width * (y + 1));
+  }
+  std::vector<unsigned char> zlib;
+  zlib.reserve(rows.size() + rows.size() / 65535 * 5 + 16);
+  zlib.push_back(0x78);
+  zlib.push_back(0x01);
+  size_t pos = 0;
+  do {
+    size_t n = std::min(rows.size() - pos, (size_t)65535);
+    zlib.push_back(pos + n == rows.size() ? 1 : 0);
+    zlib.push_back(n & 0xff);
+    zlib.push_back(n >> 8);
+    zlib.push_back(~n & 0xff);
+    zlib.push_back((~n >> 8) & 0xff);
+    zlib.insert(zlib.end(), rows.begin() + pos, rows.begin() + pos + n);
+    pos += n;
+  } while (pos < rows.size());
+  unsigned int s1 = 1, s2 = 0;
+  for (size_t i = 0; i < rows.size(); i++) {
+    s1 = (s1 + rows[i]) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+  PutBigEndian(zlib, (s2 << 16) | s1);
+
+  const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  std::vector<unsigned char> png(signature, signature + 8);
+  PutChunk(png, "IHDR", header);
+  PutChunk(png, "IDAT", zlib);
+  PutChunk(png, "IEND", std::vector<unsigned char>());
+
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (fp == NULL) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return false;
+  }
+  bool ok = (fwrite(png.data(), 1, png.size(), fp) == png.size());
+  ok = (fclose(fp) == 0) && ok;
+  return ok;
+}
+
+// ======================================================================
+
+bool RenderThumbnail(BSPTree *tree, Camera *camera, int width, int height,
+                     const std::string &filename) {
+  assert (tree != NULL && camera != NULL);
+  assert (width > 0 && height > 0);
+
+  // the same transformations as the viewer
+  camera->placeCamera(width, height);
+  glm::vec3 center;
+  tree->getBoundingBox().getCenter(center);
+  float scaleFactor = 2.0 / float(tree->getBoundingBox().maxDim());
+  View view;
+  view.ModelMatrix = glm::scale(glm::vec3(scaleFactor,scaleFactor,scaleFactor)) * glm::translate(-center);
+  view.MVP = camera->getProjectionMatrix() * camera->getViewMatrix() * view.ModelMatrix;
+  view.light = glm::vec3(view.ModelMatrix * glm::vec4(tree->LightPosition(), 1));
+  view.eye = camera->camera_position;
+  view.width = width;
+  view.height = height;
+
+  std::vector<BSPTree*> leaves;
+  tree->getLeaves(leaves);
+  ThreadPool pool;
+  std::vector<std::vector<ScreenTriangle> > leaf_tris(leaves.size());
+  for (unsigned int i = 0; i < leaves.size(); i++) {
+    const Mesh *mesh = &leaves[i]->getMesh();
+    std::vector<ScreenTriangle> *result = &leaf_tris[i];
+    pool.Submit([&view, mesh, result]() { ProjectLeaf(view, *mesh, *result); });
+  }
+  pool.Wait();
+  std::vector<ScreenTriangle> tris;
+  for (unsigned int i = 0; i < leaf_tris.size(); i++) {
+    tris.insert(tris.end(), leaf_tris[i].begin(), leaf_tris[i].end());
+    std::vector<ScreenTriangle>().swap(leaf_tris[i]);
+  }
+
+  // the triangles each tile has to draw
+  int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+  int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+  std::vector<std::vector<unsigned int> > bins(tiles_x * tiles_y);
+  for (unsigned int i = 0; i < tris.size(); i++) {
+    const ScreenTriangle &t = tris[i];
+    float min_x = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+    float max_x = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+    float min_y = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+    float max_y = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+    if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height) continue;
+    int tx0 = std::max(0, (int)min_x / TILE_SIZE);
+    int tx1 = std::min(tiles_x - 1, (int)max_x / TILE_SIZE);
+    int ty0 = std::max(0, (int)min_y / TILE_SIZE);
+    int ty1 = std::min(tiles_y - 1, (int)max_y / TILE_SIZE);
+    for (int ty = ty0; ty <= ty1; ty++) {
+      for (int tx = tx0; tx <= tx1; tx++) {
+        bins[ty * tiles_x + tx].push_back(i);
+      }
+    }
+  }
+
+  // (white, like the viewer's background)
+  std::vector<unsigned char> image(3 * width * height, 255);
+  std::vector<float> depth(width * height, 1.0f);
+  for (int ty = 0; ty < tiles_y; ty++) {
+    for (int tx = 0; tx < tiles_x; tx++) {
+      const std::vector<unsigned int> *bin = &bins[ty * tiles_x + tx];
+      if (bin->empty()) continue;
+      int x0 = tx * TILE_SIZE;
+      int y0 = ty * TILE_SIZE;
+      int x1 = std::min(width, x0 + TILE_SIZE);
+      int y1 = std::min(height, y0 + TILE_SIZE);
+      pool.Submit([&tris, bin, x0, y0, x1, y1, width, &depth, &image]() {
+        DrawTile(tris, *bin, x0, y0, x1, y1, width, depth, image);
+      });
+    }
+  }
+  pool.Wait();
+
+  bool png = (filename.size() >= 4 && filename.substr(filename.size() - 4) == ".png");
+  bool ok = png ? WritePNG(filename, width, height, image) : WritePPM(filename, width, height, image);
+  if (ok) {
+    std::cout << "wrote " << width << "x" << height << " thumbnail of " << leaves.size()
+              << " partitions to " << filename << std::endl;
+  }
+  return ok;
+}
+
+// ======================================================================
+
+// a camera saved by the viewer (operator<< of Camera)
+static Camera* ReadCamera(const std::string &filename) {
+  std::ifstream istr(filename.c_str());
+  if (!istr.good()) {
+    std::cout << "ERROR! CANNOT OPEN '" << filename << "'\n";
+    return NULL;
+  }
+  std::string token;
+  istr >> token;
+  if (token == "PerspectiveCamera") {
+    PerspectiveCamera *camera = new PerspectiveCamera();
+    istr >> *camera;
+    return camera;
+  } else if (token == "OrthographicCamera") {
+    OrthographicCamera *camera = new OrthographicCamera();
+    istr >> *camera;
+    return camera;
+  }
+  std::cout << "ERROR! '" << filename << "' IS NOT A CAMERA\n";
+  return NULL;
+}
+
+bool WriteThumbnail(BSPTree *tree, ArgParser *args) {
+  Camera *camera = NULL;
+  if (args->thumbnail_camera != "") {
+    camera = ReadCamera(args->thumbnail_camera);
+    if (camera == NULL) return false;
+  } else {
+    // (where GLCanvas::initialize puts it)
+    camera = new PerspectiveCamera(glm::vec3(1,3,8), glm::vec3(0,0,0), glm::vec3(0,1,0), 20.0);
+  }
+  bool ok = RenderThumbnail(tree, camera, args->thumbnail_width, args->thumbnail_height,
+                            args->thumbnail_file);
+  delete camera;
+  return ok;
+}
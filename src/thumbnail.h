@@ -0,0 +1,34 @@
+#ifndef _THUMBNAIL_H_
+#define _THUMBNAIL_H_
+
+#include <string>
+
+class ArgParser;
+class BSPTree;
+class Camera;
+
+// ======================================================================
+// Pictures of the partitions drawn without a GL context or a window,
+// for looking over batch results.  The leaves are rasterized on the CPU
+// in their mesh colours, lit like the viewer's default flat shading,
+// and seen through a Camera the same way the viewer sees them (the tree
+// scaled & centred into the box (-1,-1,-1)->(1,1,1)).
+//
+// The image is split into square tiles.  One ThreadPool task per leaf
+// projects its triangles, each triangle is then listed in the tiles its
+// bounding box overlaps, and every tile is drawn by its own task into
+// its own part of the image & depth buffer.
+// ======================================================================
+
+// renders the leaves of tree seen by camera into a width x height image
+// written to filename (a .png file, otherwise a binary .ppm); false if
+// it couldn't be written
+bool RenderThumbnail(BSPTree *tree, Camera *camera, int width, int height,
+                     const std::string &filename);
+
+// what -thumbnail does after -batch: renders args->thumbnail_file seen
+// by the camera saved in args->thumbnail_camera, or else from where
+// the viewer starts
+bool WriteThumbnail(BSPTree *tree, ArgParser *args);
+
+#endif
@@ -13,10 +13,11 @@ public:
 
   // ========================
   // CONSTRUCTOR & DESTRUCTOR
-  Triangle() {
+  // (ids are handed out by the Mesh, they only need to be unique
+  // within it)
+  Triangle(int _id) {
     edge = NULL;
-    id = next_triangle_id;
-    next_triangle_id++;
+    id = _id;
   }
   ~Triangle() {}
 
@@ -48,8 +49,6 @@ protected:
   // REPRESENTATION
   Edge *edge;
   int id;
-
-  static int next_triangle_id;
 };
 
 // ===========================================================
@@ -1,6 +1,9 @@
 #ifndef __VBO_STRUCTS_H__
 #define __VBO_STRUCTS_H__
 
+#include <cmath>
+#include <algorithm>
+
 // ======================================================================
 // helper structures for VBOs, for rendering (note, the data stored in
 // each of these is application specific, adjust as needed!)
@@ -11,7 +14,7 @@ struct VBOPosNormalColor {
   VBOPosNormalColor(const glm::vec3 &p, const glm::vec3 &n, const glm::vec4 &c) {
     x = p.x; y = p.y; z = p.z;
     nx = n.x; ny = n.y; nz = n.z;
-    r  =  c.x;  g =  c.y;  b =  c.z; a = c.z;
+    r  =  c.x;  g =  c.y;  b =  c.z;  a = c.a;
   }
 
   VBOPosNormalColor(const glm::vec3 &p, const glm::vec3 &n, const glm::vec4 &c, const glm::vec4 &wc, float s_, float t_) {
@@ -26,6 +29,42 @@ struct VBOPosNormalColor {
 };
 
 
+// ======================================================================
+// vertex of the buffer all the partitions are drawn from, 20 bytes: the
+// position, the normal packed as GL_INT_2_10_10_10_REV and the part it
+// belongs to (the shader looks the colour of the part up in a uniform
+// array).  The vertices are shared between the triangles, with or
+// without the wireframe: the geometry shader makes the barycentric
+// coordinates the fragment shader draws the wireframe from, and reads
+// what kind of edges a triangle has from a byte per triangle:
+//
+//   bits 0-1, 2-3, 4-5   edge ab, bc, ca (an EDGE_FLAG_* each)
+
+#define EDGE_FLAG_INTERIOR 0
+#define EDGE_FLAG_CREASE   1
+#define EDGE_FLAG_BOUNDARY 2
+
+// a signed normalized 10 bit component (in the low bits)
+inline unsigned int PackSNorm10(float v) {
+  v = std::min(1.0f, std::max(-1.0f, v));
+  int i = (int)std::floor(v * 511.0f + 0.5f);
+  return ((unsigned int)i) & 0x3ff;
+}
+
+struct VBOPartVertex {
+
+  VBOPartVertex(const glm::vec3 &p, const glm::vec3 &n, unsigned int _part) {
+    x = p.x; y = p.y; z = p.z;
+    normal = PackSNorm10(n.x) | (PackSNorm10(n.y) << 10) | (PackSNorm10(n.z) << 20);
+    part = _part;
+  }
+
+  float x, y, z;         // position
+  unsigned int normal;   // 10/10/10/2, the 2 bits unused
+  unsigned int part;     // index into the part colours
+};
+
+
 // ======================================================================
 
 struct VBOIndexedTri {